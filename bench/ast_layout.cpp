@@ -0,0 +1,276 @@
+// AST layouts: the typed node pools of `ast::Program` versus the pointer-linked virtual node classes that they replaced
+// (mirrored here, allocated in a `BumpArena` as they were). Both hold the same parsed program; the benchmark compares
+// their size and the time of a full traversal that reads every node.
+//
+//     bench/bin/ast_layout [defs = 50000] [runs = 10]
+
+#include "bench.hpp"
+
+using namespace brmh;
+
+// # Linked Layout
+
+namespace linked {
+
+struct Node {
+    explicit Node(Span span_) : span(span_) {}
+    virtual ~Node() = default;
+
+    // Count of nodes in the subtree, plus their span starts, so that each one has to be read:
+    virtual std::size_t walk() const = 0;
+
+    Span span;
+};
+
+using Expr = Node;
+using Pat = Node;
+using Stmt = Node;
+
+static std::size_t walk(std::span<Node* const> nodes) {
+    std::size_t sum = 0;
+    for (Node const* node : nodes) { sum += node->walk(); }
+    return sum;
+}
+
+struct Block : Node {
+    Block(Span span, std::span<Stmt*> stmts_, Expr* body_) : Node(span), stmts(stmts_), body(body_) {}
+    std::size_t walk() const override { return 1 + span.start + linked::walk(stmts) + body->walk(); }
+
+    std::span<Stmt*> stmts;
+    Expr* body;
+};
+
+struct If : Node {
+    If(Span span, Expr* cond_, Expr* conseq_, Expr* alt_) : Node(span), cond(cond_), conseq(conseq_), alt(alt_) {}
+    std::size_t walk() const override { return 1 + span.start + cond->walk() + conseq->walk() + alt->walk(); }
+
+    Expr* cond;
+    Expr* conseq;
+    Expr* alt;
+};
+
+struct Call : Node {
+    Call(Span span, Expr* callee_, std::span<Expr*> args_) : Node(span), callee(callee_), args(args_) {}
+    std::size_t walk() const override { return 1 + span.start + callee->walk() + linked::walk(args); }
+
+    Expr* callee;
+    std::span<Expr*> args;
+};
+
+struct PrimApp : Node {
+    PrimApp(Span span, ast::PrimApp::Op op_, std::span<Expr*> args_) : Node(span), op(op_), args(args_) {}
+    std::size_t walk() const override { return 1 + span.start + linked::walk(args); }
+
+    ast::PrimApp::Op op;
+    std::span<Expr*> args;
+};
+
+struct Leaf : Node { // `Id`, `Bool` and `Int` are all 32 bytes
+    Leaf(Span span, std::int64_t payload_) : Node(span), payload(payload_) {}
+    std::size_t walk() const override { return 1 + span.start; }
+
+    std::int64_t payload;
+};
+
+struct AnnPat : Node {
+    AnnPat(Span span, Pat* pat_, type::Type* type_) : Node(span), pat(pat_), type(type_) {}
+    std::size_t walk() const override { return 1 + span.start + pat->walk(); }
+
+    Pat* pat;
+    type::Type* type;
+};
+
+struct Val : Node {
+    Val(Span span, Pat* pat_, Expr* val_expr_) : Node(span), pat(pat_), val_expr(val_expr_) {}
+    std::size_t walk() const override { return 1 + span.start + pat->walk() + val_expr->walk(); }
+
+    Pat* pat;
+    Expr* val_expr;
+};
+
+struct FunDef : Node {
+    FunDef(Span span, Name name_, std::span<Pat*> params_, type::Type* codomain_, Expr* body_)
+        : Node(span), name(name_), params(params_), codomain(codomain_), body(body_) {}
+    std::size_t walk() const override { return 1 + span.start + linked::walk(params) + body->walk(); }
+
+    Name name;
+    std::span<Pat*> params;
+    type::Type* codomain;
+    Expr* body;
+};
+
+// Copies an `ast::Program` into `arena`:
+struct Builder {
+    ast::Program const& program;
+    BumpArena& arena;
+
+    template<typename T, typename... Args>
+    T* make(Args... args) { return new (arena.alloc<T>()) T(args...); }
+
+    template<typename Ref>
+    std::span<Node*> list(std::span<Ref const> refs) {
+        Node** const nodes = static_cast<Node**>(arena.alloc_array<Node*>(refs.size()));
+        for (std::size_t i = 0; i < refs.size(); ++i) { nodes[i] = build(refs[i]); }
+        return {nodes, refs.size()};
+    }
+
+    Node* build(ast::Expr expr) {
+        switch (expr.tag()) {
+        case ast::ExprTag::BLOCK: {
+            ast::Block const& block = program.blocks[expr.index()];
+            return make<Block>(block.span, list(program.stmts(block.stmts)), build(block.body));
+        }
+        case ast::ExprTag::IF: {
+            ast::If const& if_ = program.ifs[expr.index()];
+            return make<If>(if_.span, build(if_.cond), build(if_.conseq), build(if_.alt));
+        }
+        case ast::ExprTag::CALL: {
+            ast::Call const& call = program.calls[expr.index()];
+            return make<Call>(call.span, build(call.callee), list(program.exprs(call.args)));
+        }
+        case ast::ExprTag::PRIM_APP: {
+            ast::PrimApp const& prim_app = program.prim_apps[expr.index()];
+            return make<PrimApp>(prim_app.span, prim_app.op, list(program.exprs(prim_app.args)));
+        }
+        case ast::ExprTag::ID: {
+            ast::Id const& id = program.ids[expr.index()];
+            return make<Leaf>(id.span, std::int64_t(Name::Hash()(id.name)));
+        }
+        case ast::ExprTag::BOOL: return make<Leaf>(program.bools[expr.index()].span, program.bools[expr.index()].value);
+        case ast::ExprTag::INT: return make<Leaf>(program.ints[expr.index()].span, program.ints[expr.index()].value);
+        case ast::ExprTag::COUNT: break;
+        }
+        std::abort();
+    }
+
+    Node* build(ast::Pat pat) {
+        switch (pat.tag()) {
+        case ast::PatTag::ID: {
+            ast::IdPat const& id_pat = program.id_pats[pat.index()];
+            return make<Leaf>(id_pat.span, std::int64_t(Name::Hash()(id_pat.name)));
+        }
+        case ast::PatTag::ANN: {
+            ast::AnnPat const& ann_pat = program.ann_pats[pat.index()];
+            return make<AnnPat>(ann_pat.span, build(ann_pat.pat), ann_pat.type);
+        }
+        case ast::PatTag::COUNT: break;
+        }
+        std::abort();
+    }
+
+    Node* build(ast::Stmt stmt) {
+        ast::Val const& val = program.vals[stmt.index()];
+        return make<Val>(val.span, build(val.pat), build(val.val_expr));
+    }
+
+    Node* build(ast::Def def) {
+        ast::FunDef const& fun_def = program.fun_defs[def.index()];
+        return make<FunDef>(fun_def.span, fun_def.name, list(program.pats(fun_def.params)), fun_def.codomain,
+                            build(fun_def.body));
+    }
+};
+
+} // namespace linked
+
+// # Pool Layout
+
+// The same traversal as `linked::Node::walk`, dispatching on `Ref` tags:
+struct PoolWalk {
+    ast::Program const& program;
+
+    template<typename Ref>
+    std::size_t walk(std::span<Ref const> refs) const {
+        std::size_t sum = 0;
+        for (Ref const ref : refs) { sum += walk(ref); }
+        return sum;
+    }
+
+    std::size_t walk(ast::Expr expr) const {
+        switch (expr.tag()) {
+        case ast::ExprTag::BLOCK: {
+            ast::Block const& block = program.blocks[expr.index()];
+            return 1 + block.span.start + walk(program.stmts(block.stmts)) + walk(block.body);
+        }
+        case ast::ExprTag::IF: {
+            ast::If const& if_ = program.ifs[expr.index()];
+            return 1 + if_.span.start + walk(if_.cond) + walk(if_.conseq) + walk(if_.alt);
+        }
+        case ast::ExprTag::CALL: {
+            ast::Call const& call = program.calls[expr.index()];
+            return 1 + call.span.start + walk(call.callee) + walk(program.exprs(call.args));
+        }
+        case ast::ExprTag::PRIM_APP: {
+            ast::PrimApp const& prim_app = program.prim_apps[expr.index()];
+            return 1 + prim_app.span.start + walk(program.exprs(prim_app.args));
+        }
+        case ast::ExprTag::ID: return 1 + program.ids[expr.index()].span.start;
+        case ast::ExprTag::BOOL: return 1 + program.bools[expr.index()].span.start;
+        case ast::ExprTag::INT: return 1 + program.ints[expr.index()].span.start;
+        case ast::ExprTag::COUNT: break;
+        }
+        std::abort();
+    }
+
+    std::size_t walk(ast::Pat pat) const {
+        switch (pat.tag()) {
+        case ast::PatTag::ID: return 1 + program.id_pats[pat.index()].span.start;
+        case ast::PatTag::ANN: {
+            ast::AnnPat const& ann_pat = program.ann_pats[pat.index()];
+            return 1 + ann_pat.span.start + walk(ann_pat.pat);
+        }
+        case ast::PatTag::COUNT: break;
+        }
+        std::abort();
+    }
+
+    std::size_t walk(ast::Stmt stmt) const {
+        ast::Val const& val = program.vals[stmt.index()];
+        return 1 + val.span.start + walk(val.pat) + walk(val.val_expr);
+    }
+
+    std::size_t walk(ast::Def def) const {
+        ast::FunDef const& fun_def = program.fun_defs[def.index()];
+        return 1 + fun_def.span.start + walk(program.pats(fun_def.params)) + walk(fun_def.body);
+    }
+};
+
+int main(int argc, char** argv) {
+    std::size_t const def_count = bench::arg(argc, argv, 1, 50000);
+    int const runs = static_cast<int>(bench::arg(argc, argv, 2, 10));
+
+    harness::TempFile const file(bench::defs(def_count));
+    SourceMap sources;
+    FileId const file_id = sources.add(Src::file(file.path()));
+    Names names;
+    type::Types types(names);
+
+    TokenBuffer const tokens = Lexer::tokenize(sources, file_id, names);
+    ast::Program pools;
+    double const parse_ms = bench::best_ms(1, [&] { pools = Parser(tokens, names, types).program(); });
+
+    BumpArena arena;
+    std::vector<linked::Node*> linked_defs;
+    linked::Builder builder {pools, arena};
+    for (ast::Def const def : pools.defs) { linked_defs.push_back(builder.build(def)); }
+
+    std::size_t pool_sum = 0;
+    double const pool_ms = bench::best_ms(runs, [&] {
+        PoolWalk const walker {pools};
+        pool_sum = walker.walk(std::span<ast::Def const>(pools.defs));
+    });
+    std::size_t linked_sum = 0;
+    double const linked_ms = bench::best_ms(runs, [&] {
+        linked_sum = linked::walk(linked_defs);
+    });
+    if (pool_sum != linked_sum) {
+        std::cerr << "layouts disagree: " << pool_sum << " != " << linked_sum << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    BumpArena::Stats const pool_stats = pools.arena_stats();
+    std::cout << def_count << " defs, parsed into pools in " << parse_ms << " ms\n"
+              << "pools:  " << pool_stats.requested / 1000 << " kB requested, " << pool_stats.chunk_bytes / 1000
+              << " kB of chunks, walk " << pool_ms << " ms\n"
+              << "linked: " << arena.stats().requested / 1000 << " kB requested, " << arena.stats().chunk_bytes / 1000
+              << " kB of chunks, walk " << linked_ms << " ms\n";
+}
@@ -0,0 +1,55 @@
+#ifndef BRMH_BENCH_HPP
+#define BRMH_BENCH_HPP
+
+// Shared scaffolding for the benchmarks in this directory, which build.sh builds. Sizes can be scaled from the command
+// line.
+
+#include "../harness/harness.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+
+namespace brmh::bench {
+
+// Best wall clock milliseconds over `runs` calls of `f`, to filter out scheduling noise:
+template<typename F>
+double best_ms(int runs, F&& f) {
+    double best = std::numeric_limits<double>::infinity();
+    for (int i = 0; i < runs; ++i) {
+        auto const start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double, std::milli> const elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+inline std::size_t volatile sink;
+
+// Keep `value` alive so that the optimizer cannot drop the work that computed it:
+inline void keep(std::size_t value) { sink = value; }
+
+// Positional command line argument `i` as a count, or `default_` if it was not given:
+inline std::size_t arg(int argc, char** argv, int i, std::size_t default_) {
+    return i < argc ? std::strtoull(argv[i], nullptr, 10) : default_;
+}
+
+// `count` recursive factorial-like functions, about 150 bytes and 50 tokens each:
+inline std::string defs(std::size_t count) {
+    std::string source;
+    for (std::size_t i = 0; i < count; ++i) {
+        std::string const name = "f" + std::to_string(i);
+        source += "fun " + name + "(n) : i64 {\n"
+                  "    if __eqI64(n, 0) { 1 } else { val nn = __subWI64(n, 1); __mulWI64(n, " + name + "(nn)) }\n"
+                  "}\n";
+    }
+    return source;
+}
+
+} // namespace brmh::bench
+
+#endif // BRMH_BENCH_HPP
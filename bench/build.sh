@@ -0,0 +1,10 @@
+#! /bin/sh
+
+# Build every benchmark into bench/bin. Run from the repository root, like build.sh.
+# `CXX` and `CXXFLAGS` are passed through, e.g. to point at a different LLVM.
+
+mkdir -p bench/bin
+for bench in bench/*.cpp; do
+    ${CXX:-c++} ${CXXFLAGS} `llvm-config --cxxflags` -std=c++20 -O2 -pthread -fexceptions -Wall -Wextra -Werror \
+        "$bench" -o "bench/bin/`basename "$bench" .cpp`" `llvm-config --ldflags --system-libs --libs core` || exit 1
+done
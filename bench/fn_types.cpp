@@ -0,0 +1,46 @@
+// Wide, deeply nested function types, the worst case for eager occurs checks and level adjustment: each def has D
+// function parameters, each called with the next and W plain arguments, so the type of `g0` is D deep and W wide. Its
+// N `val v = g0` then each bind a `Uv` to all of that. Times `check` at a quarter, half and all of N, so that a
+// traversal per binding shows up as superlinear growth.
+//
+//     bench/bin/fn_types [defs = 20] [depth = 100] [width = 20] [vals = 1000] [runs = 3]
+
+#include "bench.hpp"
+
+using namespace brmh;
+
+// `defs` copies of `fun f(g0, ..., g{depth}, a0, ..., a{width - 1})`, with `vals` copies of `g0` at the end of each:
+static std::string nested_fn_types(std::size_t defs, std::size_t depth, std::size_t width, std::size_t vals) {
+    std::string args;
+    for (std::size_t j = 0; j < width; ++j) { args += ", a" + std::to_string(j); }
+
+    std::string source;
+    for (std::size_t d = 0; d < defs; ++d) {
+        source += "fun f" + std::to_string(d) + "(g0";
+        for (std::size_t i = 1; i <= depth; ++i) { source += ", g" + std::to_string(i); }
+        source += args + ") : i64 {\n";
+        for (std::size_t i = 0; i < depth; ++i) {
+            source += "    val u" + std::to_string(i) + " = g" + std::to_string(i) + "(g" + std::to_string(i + 1)
+                      + args + ");\n";
+        }
+        for (std::size_t k = 0; k < vals; ++k) { source += "    val v" + std::to_string(k) + " = g0;\n"; }
+        source += "    0\n}\n\n";
+    }
+    return source + "fun main() : i64 { 0 }\n";
+}
+
+int main(int argc, char** argv) {
+    std::size_t const defs = bench::arg(argc, argv, 1, 20);
+    std::size_t const depth = bench::arg(argc, argv, 2, 100);
+    std::size_t const width = bench::arg(argc, argv, 3, 20);
+    std::size_t const vals = bench::arg(argc, argv, 4, 1000);
+    int const runs = static_cast<int>(bench::arg(argc, argv, 5, 3));
+
+    for (std::size_t divisor : {4, 2, 1}) {
+        harness::Frontend frontend(nested_fn_types(defs, depth, width, vals / divisor));
+
+        double const ms = bench::best_ms(runs, [&] { bench::keep(frontend.check(1).defs.size()); });
+        std::cout << defs << " defs, D=" << depth << ", W=" << width << ", N=" << vals / divisor << ": check " << ms
+                  << " ms\n";
+    }
+}
@@ -0,0 +1,53 @@
+// Arena memory of the fast and CPS IRs (and of the dominator tree scratch data) for a generated program. Reports the
+// arena stats along with the bytes that `operator new[]`, which allocates the arena chunks, handed out during each
+// phase.
+//
+//     bench/bin/ir_memory [defs = 26000]
+
+#include <cstdlib>
+#include <new>
+
+static std::size_t array_bytes = 0;
+
+void* operator new[](std::size_t size) {
+    array_bytes += size;
+    if (void* const ptr = std::malloc(size)) { return ptr; }
+    throw std::bad_alloc();
+}
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+#include "bench.hpp"
+
+using namespace brmh;
+
+static void report(char const* ir, std::size_t new_bytes, BumpArena::Stats const& stats) {
+    std::cout << ir << ": " << new_bytes / 1024 << " KiB new[]'d; arena " << stats.requested / 1024 << " KiB requested, "
+              << stats.alignment_waste / 1024 << " KiB padding, " << stats.chunks << " chunks of "
+              << stats.chunk_bytes / 1024 << " KiB\n";
+}
+
+int main(int argc, char** argv) {
+    std::size_t const def_count = bench::arg(argc, argv, 1, 26000);
+
+    harness::Frontend frontend(bench::defs(def_count) + "fun main () : i64 { f0(5) }\n");
+
+    std::size_t const before_check = array_bytes;
+    fast::Program const typed_program = frontend.check(1);
+    std::size_t const before_cps = array_bytes;
+    cps::Program const cps_program = typed_program.to_cps(frontend.names, frontend.types);
+    std::size_t const after_cps = array_bytes;
+
+    BumpArena scratch;
+    std::size_t const before_doms = array_bytes;
+    for (cps::Fn* const fn : cps_program.externs) {
+        BumpArena::Mark const mark(scratch);
+        bench::keep(cps::doms::DomTree::of(fn, scratch).block_nodes.size());
+    }
+    std::size_t const after_doms = array_bytes;
+
+    std::cout << def_count << " defs\n";
+    report("fast", before_cps - before_check, typed_program.arena_stats());
+    report("cps", after_cps - before_cps, cps_program.arena().stats());
+    report("doms (rewound per fn)", after_doms - before_doms, scratch.stats());
+}
@@ -0,0 +1,32 @@
+// Lexer throughput in tokens/s and MB/s on a generated source, from a mapped `Src` to a `TokenBuffer`.
+// Identifiers are interned into one `Names` across runs, as the driver interns all files into one.
+//
+//     bench/bin/lex [MB = 16] [runs = 10]
+
+#include "bench.hpp"
+
+using namespace brmh;
+
+int main(int argc, char** argv) {
+    std::size_t const mb = bench::arg(argc, argv, 1, 16);
+    int const runs = static_cast<int>(bench::arg(argc, argv, 2, 10));
+
+    std::string source;
+    while (source.size() < mb * 1000000) { source += bench::defs(1000); }
+    harness::TempFile const file(source);
+
+    SourceMap sources;
+    FileId const file_id = sources.add(Src::file(file.path()));
+    Names names;
+
+    std::size_t token_count = 0;
+    double const ms = bench::best_ms(runs, [&] {
+        TokenBuffer const tokens = Lexer::tokenize(sources, file_id, names);
+        token_count = tokens.types.size();
+    });
+
+    double const seconds = ms / 1000;
+    std::cout << "source: " << static_cast<double>(source.size()) / 1e6 << " MB, " << token_count << " tokens\n"
+              << "lex: " << ms << " ms, " << static_cast<double>(token_count) / seconds / 1e6 << " Mtokens/s, "
+              << static_cast<double>(source.size()) / seconds / 1e6 << " MB/s\n";
+}
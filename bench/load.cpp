@@ -0,0 +1,42 @@
+// Source loading: the old `fstream` -> `stringstream` -> `std::string` copy versus `Src::file`, which maps the file.
+// Every page is touched so that the lazily mapped file is actually read.
+//
+//     bench/bin/load [MB = 16] [runs = 20]
+
+#include "bench.hpp"
+
+#include <sstream>
+
+using namespace brmh;
+
+static std::size_t touch_pages(const char* chars, std::size_t size) {
+    std::size_t sum = 0;
+    for (std::size_t i = 0; i < size; i += 4096) { sum += static_cast<unsigned char>(chars[i]); }
+    return sum;
+}
+
+int main(int argc, char** argv) {
+    std::size_t const mb = bench::arg(argc, argv, 1, 16);
+    int const runs = static_cast<int>(bench::arg(argc, argv, 2, 20));
+
+    std::string source;
+    while (source.size() < mb * 1000000) { source += bench::defs(1000); }
+    harness::TempFile const file(source);
+    double const size_mb = static_cast<double>(source.size()) / 1e6;
+
+    double const copy_ms = bench::best_ms(runs, [&] {
+        std::fstream infile(file.path(), std::ios::in);
+        std::stringstream ss;
+        ss << infile.rdbuf();
+        std::string const chars = ss.str();
+        bench::keep(touch_pages(chars.data(), chars.size()));
+    });
+    double const map_ms = bench::best_ms(runs, [&] {
+        Src const src = Src::file(file.path());
+        bench::keep(touch_pages(src.source_code(), src.size()));
+    });
+
+    std::cout << "source: " << size_mb << " MB\n"
+              << "fstream copy: " << copy_ms / size_mb << " ms/MB\n"
+              << "Src::file:    " << map_ms / size_mb << " ms/MB\n";
+}
@@ -0,0 +1,57 @@
+// Contention on the `Names` interner: every thread interns source identifiers from a shared pool (so that they hit the
+// same shards) and creates fresh names, as the parser and typer threads do. Reports the throughput at each thread
+// count, with and without per-task `Names::Unit`s.
+//
+//     bench/bin/names [names per thread = 1000000] [max threads = 8]
+
+#include "bench.hpp"
+
+using namespace brmh;
+
+static constexpr std::size_t IDENTIFIER_COUNT = 1 << 14;
+static constexpr std::size_t TASK_COUNT = 64;
+
+// Each thread does `ops` operations: a third each of `sourced`, `fresh` and `freshen`:
+static void churn(Names& names, std::vector<std::string> const& identifiers, std::size_t thread, std::size_t ops) {
+    std::size_t sum = 0;
+    for (std::size_t i = 0; i < ops; ++i) {
+        std::string const& identifier = identifiers[(thread * 7919 + i) % identifiers.size()];
+        switch (i % 3) {
+        case 0: sum += Name::Hash()(names.sourced(identifier.data(), identifier.size())); break;
+        case 1: sum += Name::Hash()(names.fresh()); break;
+        case 2: sum += Name::Hash()(names.freshen(names.sourced(identifier.data(), identifier.size()))); break;
+        }
+    }
+    bench::keep(sum);
+}
+
+int main(int argc, char** argv) {
+    std::size_t const ops = bench::arg(argc, argv, 1, 1000000);
+    std::size_t const max_threads = bench::arg(argc, argv, 2, 8);
+
+    std::vector<std::string> identifiers;
+    for (std::size_t i = 0; i < IDENTIFIER_COUNT; ++i) { identifiers.push_back("identifier" + std::to_string(i)); }
+
+    for (std::size_t threads = 1; threads <= max_threads; threads *= 2) {
+        std::size_t const total = ops * threads;
+
+        double const plain_ms = bench::best_ms(3, [&] {
+            Names names;
+            parallel_for(threads, threads, [&](std::size_t thread) { churn(names, identifiers, thread, ops); });
+        });
+
+        // The same work split into tasks with a `Unit` each, numbered in task order at the end:
+        double const unit_ms = bench::best_ms(3, [&] {
+            Names names;
+            std::vector<Names::Unit> units(TASK_COUNT, Names::Unit(names));
+            parallel_for(TASK_COUNT, threads, [&](std::size_t task) {
+                Names::UnitScope const scope(units[task]);
+                churn(names, identifiers, task, total / TASK_COUNT);
+            });
+            for (Names::Unit& unit : units) { names.number(unit); }
+        });
+
+        std::cout << threads << " threads: " << static_cast<double>(total) / plain_ms / 1e3 << " M names/s, "
+                  << static_cast<double>(total) / unit_ms / 1e3 << " M names/s in units\n";
+    }
+}
@@ -0,0 +1,36 @@
+// Long straight-line functions, which stress the scoped `TypeEnv`: a single function of N vals, either "far" (every
+// val reads the first one, bound N scopes out) or "long" (every val reads the previous one). Times `check` at a
+// quarter, half and all of N, so that superlinear growth shows.
+//
+//     bench/bin/straight_line [far vals = 40000] [long vals = 1000000] [runs = 5]
+
+#include "bench.hpp"
+
+using namespace brmh;
+
+// `val x{i} = __addWI64(x{far ? 0 : i - 1}, x{i - 1})` for `i` in `1..count`:
+static std::string straight_line(std::size_t count, bool far) {
+    std::string source = "fun main () : i64 {\n    val x0 = 1;\n";
+    for (std::size_t i = 1; i < count; ++i) {
+        std::string const prev = "x" + std::to_string(i - 1);
+        source += "    val x" + std::to_string(i) + " = __addWI64(" + (far ? std::string("x0") : prev) + ", " + prev
+                  + ");\n";
+    }
+    return source + "    x" + std::to_string(count - 1) + "\n}\n";
+}
+
+static void time_check(char const* family, std::size_t count, bool far, int runs) {
+    harness::Frontend frontend(straight_line(count, far));
+
+    double const ms = bench::best_ms(runs, [&] { bench::keep(frontend.check(1).defs.size()); });
+    std::cout << family << count << ": check " << ms << " ms\n";
+}
+
+int main(int argc, char** argv) {
+    std::size_t const far_count = bench::arg(argc, argv, 1, 40000);
+    std::size_t const long_count = bench::arg(argc, argv, 2, 1000000);
+    int const runs = static_cast<int>(bench::arg(argc, argv, 3, 5));
+
+    for (std::size_t divisor : {4, 2, 1}) { time_check("far", far_count / divisor, true, runs); }
+    for (std::size_t divisor : {4, 2, 1}) { time_check("long", long_count / divisor, false, runs); }
+}
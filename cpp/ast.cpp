@@ -1,147 +1,480 @@
 #include "ast.hpp"
 
-#include <cstring>
+#include <algorithm>
+#include <iterator>
+#include <unordered_map>
 
 namespace brmh::ast {
 
-// # Expr
+// # PrimApp
 
-Expr::Expr(Span sp) : span(sp) {}
+void PrimApp::print_op(Op op, std::ostream &dest) {
+    switch (op) {
+    case Op::ADD_W_I64: dest << "__addWI64"; break;
+    case Op::SUB_W_I64: dest << "__subWI64"; break;
+    case Op::MUL_W_I64: dest << "__mulWI64"; break;
+    case Op::EQ_I64: dest << "__eqI64";
+    }
+}
 
-// ## Block
+// # Program
 
-void Block::print(Names const& names, std::ostream& dest) const {
-    dest << "{\n";
+// ## Merging
 
-    for (Stmt* stmt : stmts) {
-        dest << "        ";
-        stmt->print(names, dest);
-        dest << ";\n";
+Program Program::merge(std::vector<Program>&& programs) {
+    Program program = std::move(programs[0]);
+
+    for (std::size_t i = 1; i < programs.size(); ++i) {
+        program.append(std::move(programs[i]));
+    }
+
+    return program;
+}
+
+void Program::append(Program&& other) {
+    // Keep the pages of `other` alive and splice them on. Its refs then just need to be shifted, in place:
+    absorbed_.push_back(std::move(other.arena_));
+    std::move(other.absorbed_.begin(), other.absorbed_.end(), std::back_inserter(absorbed_));
+    other.absorbed_.clear();
+
+    Offsets const offsets {
+        .exprs = {
+            blocks.splice(std::move(other.blocks)),
+            ifs.splice(std::move(other.ifs)),
+            calls.splice(std::move(other.calls)),
+            prim_apps.splice(std::move(other.prim_apps)),
+            ids.splice(std::move(other.ids)),
+            bools.splice(std::move(other.bools)),
+            ints.splice(std::move(other.ints))
+        },
+        .pats = {id_pats.splice(std::move(other.id_pats)), ann_pats.splice(std::move(other.ann_pats))},
+        .stmts = {vals.splice(std::move(other.vals))},
+        .expr_lists = expr_lists.splice(std::move(other.expr_lists)),
+        .stmt_lists = stmt_lists.splice(std::move(other.stmt_lists)),
+        .pat_lists = pat_lists.splice(std::move(other.pat_lists))
+    };
+
+    // Each list belongs to exactly one node, so they get rebased along with it (which also skips the unused slots
+    // that `Pool::append` may leave between lists):
+    auto const rebase_exprs = [&](Range& range) {
+        range.start += offsets.expr_lists;
+        for (Expr& expr : expr_lists.items(range.start, range.count)) { expr = offsets(expr); }
+    };
+    auto const rebase_stmts = [&](Range& range) {
+        range.start += offsets.stmt_lists;
+        for (Stmt& stmt : stmt_lists.items(range.start, range.count)) { stmt = offsets(stmt); }
+    };
+    auto const rebase_pats = [&](Range& range) {
+        range.start += offsets.pat_lists;
+        for (Pat& pat : pat_lists.items(range.start, range.count)) { pat = offsets(pat); }
+    };
+
+    // Only one kind of `Def` and they are only referred to from `defs`:
+    std::uint32_t const fun_defs_offset = fun_defs.splice(std::move(other.fun_defs));
+    for (Def const def : other.defs) {
+        defs.push_back(Def(def.tag(), def.index() + fun_defs_offset));
+    }
+
+    for (std::uint32_t i = offsets.exprs[std::size_t(ExprTag::BLOCK)]; i < blocks.size(); ++i) {
+        Block& block = blocks[i];
+        rebase_stmts(block.stmts);
+        block.body = offsets(block.body);
+    }
+    for (std::uint32_t i = offsets.exprs[std::size_t(ExprTag::IF)]; i < ifs.size(); ++i) {
+        If& if_ = ifs[i];
+        if_ = If {if_.span, offsets(if_.cond), offsets(if_.conseq), offsets(if_.alt)};
+    }
+    for (std::uint32_t i = offsets.exprs[std::size_t(ExprTag::CALL)]; i < calls.size(); ++i) {
+        Call& call = calls[i];
+        call.callee = offsets(call.callee);
+        rebase_exprs(call.args);
+    }
+    for (std::uint32_t i = offsets.exprs[std::size_t(ExprTag::PRIM_APP)]; i < prim_apps.size(); ++i) {
+        rebase_exprs(prim_apps[i].args);
+    }
+
+    for (std::uint32_t i = offsets.pats[std::size_t(PatTag::ANN)]; i < ann_pats.size(); ++i) {
+        ann_pats[i].pat = offsets(ann_pats[i].pat);
     }
 
-    dest << "        ";
-    body->print(names, dest);
+    for (std::uint32_t i = offsets.stmts[std::size_t(StmtTag::VAL)]; i < vals.size(); ++i) {
+        Val& val = vals[i];
+        val.pat = offsets(val.pat);
+        val.val_expr = offsets(val.val_expr);
+    }
+
+    for (std::uint32_t i = fun_defs_offset; i < fun_defs.size(); ++i) {
+        FunDef& fun_def = fun_defs[i];
+        rebase_pats(fun_def.params);
+        fun_def.body = offsets(fun_def.body);
+    }
 
-    dest << "\n    }";
+    other = Program();
 }
 
-// # If
+BumpArena::Stats Program::arena_stats() const {
+    BumpArena::Stats stats = arena_.stats();
+    for (BumpArena const& arena : absorbed_) {
+        stats += arena.stats();
+    }
+    return stats;
+}
 
-If::If(Span span_, Expr* cond_, Block* conseq_, Block* alt_) : Expr(span_), cond(cond_), conseq(conseq_), alt(alt_) {}
+// ## Spans
+
+Span Program::span(Expr expr) const {
+    switch (expr.tag()) {
+    case ExprTag::BLOCK: return blocks[expr.index()].span;
+    case ExprTag::IF: return ifs[expr.index()].span;
+    case ExprTag::CALL: return calls[expr.index()].span;
+    case ExprTag::PRIM_APP: return prim_apps[expr.index()].span;
+    case ExprTag::ID: return ids[expr.index()].span;
+    case ExprTag::BOOL: return bools[expr.index()].span;
+    case ExprTag::INT: return ints[expr.index()].span;
+    case ExprTag::COUNT: break;
+    }
+    assert(false); // unreachable
+}
 
-void If::print(Names const& names, std::ostream& dest) const {
-    dest << "if ";
-    cond->print(names, dest);
-    dest << " {\n        ";
-    conseq->print(names, dest);
-    dest << "\n    } else {\n        ";
-    alt->print(names, dest);
-    dest << "\n    }";
+Span Program::span(Pat pat) const {
+    switch (pat.tag()) {
+    case PatTag::ID: return id_pats[pat.index()].span;
+    case PatTag::ANN: return ann_pats[pat.index()].span;
+    case PatTag::COUNT: break;
+    }
+    assert(false); // unreachable
 }
 
-// ## PrimApp
+// ## Call Graph
 
-PrimApp::PrimApp(Span sp, Op op_, std::vector<Expr*>&& args_) : Expr(sp), op(op_), args(std::move(args_)) {}
+Program::DefComponents Program::def_components() const {
+    std::uint32_t const def_count = static_cast<std::uint32_t>(defs.size());
 
-void PrimApp::print(Names const& names, std::ostream& dest) const {
-    print_op(op, dest);
+    // A local that shadows a def counts as a reference to it too. That can only merge components, which at worst makes
+    // the typer generalize less:
+    std::unordered_map<Name, std::uint32_t, Name::Hash> def_indices;
+    def_indices.reserve(def_count);
+    for (std::uint32_t i = 0; i < def_count; ++i) {
+        Def const def = defs[i];
+        switch (def.tag()) {
+        case DefTag::FUN: def_indices.insert({fun_defs[def.index()].name, i}); break;
+        case DefTag::COUNT: assert(false); // unreachable
+        }
+    }
 
-    dest << '(';
+    // Adjacency lists, `callees[callee_starts[i]:callee_starts[i + 1]]` for `defs[i]`:
+    std::vector<std::uint32_t> callees;
+    std::vector<std::uint32_t> callee_starts;
+    callee_starts.reserve(def_count + 1);
+    std::vector<Expr> pending; // An explicit stack, like the typer's
+    for (Def const def : defs) {
+        callee_starts.push_back(static_cast<std::uint32_t>(callees.size()));
+
+        switch (def.tag()) {
+        case DefTag::FUN: pending.push_back(fun_defs[def.index()].body); break;
+        case DefTag::COUNT: assert(false); // unreachable
+        }
 
-    auto arg = args.begin();
-    if (arg != args.end()) {
-        (*arg)->print(names, dest);
-        ++arg;
+        while (!pending.empty()) {
+            Expr const expr = pending.back();
+            pending.pop_back();
+
+            switch (expr.tag()) {
+            case ExprTag::BLOCK: {
+                Block const& block = blocks[expr.index()];
+                pending.push_back(block.body);
+                for (Stmt const stmt : stmts(block.stmts)) {
+                    switch (stmt.tag()) {
+                    case StmtTag::VAL: pending.push_back(vals[stmt.index()].val_expr); break;
+                    case StmtTag::COUNT: assert(false); // unreachable
+                    }
+                }
+                break;
+            }
+
+            case ExprTag::IF: {
+                If const& if_ = ifs[expr.index()];
+                pending.insert(pending.end(), {if_.cond, if_.conseq, if_.alt});
+                break;
+            }
+
+            case ExprTag::CALL: {
+                Call const& call = calls[expr.index()];
+                pending.push_back(call.callee);
+                std::span<Expr const> const args = exprs(call.args);
+                pending.insert(pending.end(), args.begin(), args.end());
+                break;
+            }
+
+            case ExprTag::PRIM_APP: {
+                std::span<Expr const> const args = exprs(prim_apps[expr.index()].args);
+                pending.insert(pending.end(), args.begin(), args.end());
+                break;
+            }
+
+            case ExprTag::ID: {
+                auto const it = def_indices.find(ids[expr.index()].name);
+                if (it != def_indices.end()) { callees.push_back(it->second); }
+                break;
+            }
+
+            case ExprTag::BOOL: case ExprTag::INT: break;
+
+            case ExprTag::COUNT: assert(false); // unreachable
+            }
+        }
+    }
+    callee_starts.push_back(static_cast<std::uint32_t>(callees.size()));
+
+    // Tarjan's algorithm, which finds components callees first. Iterative, since call chains can be long:
+    static constexpr std::uint32_t UNVISITED = UINT32_MAX;
+    std::vector<std::uint32_t> preorder(def_count, UNVISITED);
+    std::vector<std::uint32_t> lowlinks(def_count);
+    std::vector<bool> on_stack(def_count, false);
+    std::vector<std::uint32_t> stack;
+    struct Visit {
+        std::uint32_t def;
+        std::uint32_t next_callee; // Index into `callees`
+    };
+    std::vector<Visit> visits;
+    std::uint32_t next_preorder = 0;
+    std::vector<std::uint32_t> component_of(def_count);
+
+    auto const start = [&] (std::uint32_t def) {
+        preorder[def] = lowlinks[def] = next_preorder++;
+        stack.push_back(def);
+        on_stack[def] = true;
+        visits.push_back(Visit {def, callee_starts[def]});
+    };
+
+    DefComponents res;
+    res.defs.reserve(def_count);
+    for (std::uint32_t root = 0; root < def_count; ++root) {
+        if (preorder[root] != UNVISITED) { continue; }
+
+        start(root);
+        while (!visits.empty()) {
+            Visit& visit = visits.back();
+            std::uint32_t const def = visit.def;
+
+            if (visit.next_callee < callee_starts[def + 1]) {
+                std::uint32_t const callee = callees[visit.next_callee++];
+                if (preorder[callee] == UNVISITED) {
+                    start(callee);
+                } else if (on_stack[callee]) {
+                    lowlinks[def] = std::min(lowlinks[def], preorder[callee]);
+                }
+            } else {
+                visits.pop_back();
+                if (!visits.empty()) {
+                    std::uint32_t const caller = visits.back().def;
+                    lowlinks[caller] = std::min(lowlinks[caller], lowlinks[def]);
+                }
+
+                if (lowlinks[def] == preorder[def]) {
+                    std::uint32_t const component = static_cast<std::uint32_t>(res.components.size());
+                    std::uint32_t const component_start = static_cast<std::uint32_t>(res.defs.size());
+                    std::uint32_t member;
+                    do {
+                        member = stack.back();
+                        stack.pop_back();
+                        on_stack[member] = false;
+                        component_of[member] = component;
+                        res.defs.push_back(member);
+                    } while (member != def);
+
+                    // Source order within the component, for deterministic output:
+                    std::sort(res.defs.begin() + component_start, res.defs.end());
+                    res.components.push_back(DefComponents::Component {
+                        Range {component_start, static_cast<std::uint32_t>(res.defs.size()) - component_start},
+                        Range {0, 0}
+                    });
+                }
+            }
+        }
+    }
 
-        for (; arg != args.end(); ++arg) {
-            dest << ", ";
-            (*arg)->print(names, dest);
+    // The edges between components, for scheduling them. `recorded_by` deduplicates them:
+    std::vector<std::uint32_t> recorded_by(res.components.size(), UNVISITED);
+    for (std::uint32_t component = 0; component < res.components.size(); ++component) {
+        Range const members = res.components[component].defs;
+        std::uint32_t const callees_start = static_cast<std::uint32_t>(res.callees.size());
+
+        for (std::uint32_t i = members.start; i < members.start + members.count; ++i) {
+            std::uint32_t const def = res.defs[i];
+            for (std::uint32_t j = callee_starts[def]; j < callee_starts[def + 1]; ++j) {
+                std::uint32_t const callee = component_of[callees[j]];
+                if (callee != component && recorded_by[callee] != component) {
+                    assert(callee < component);
+                    recorded_by[callee] = component;
+                    res.callees.push_back(callee);
+                }
+            }
         }
+
+        res.components[component].callees =
+            Range {callees_start, static_cast<std::uint32_t>(res.callees.size()) - callees_start};
     }
 
-    dest << ')';
+    return res;
 }
 
-void PrimApp::print_op(Op op, std::ostream &dest) {
-    switch (op) {
-    case Op::ADD_W_I64: dest << "__addWI64"; break;
-    case Op::SUB_W_I64: dest << "__subWI64"; break;
-    case Op::MUL_W_I64: dest << "__mulWI64"; break;
-    case Op::EQ_I64: dest << "__eqI64";
+// ## Printing
+
+void Program::print(Names const& names, std::ostream& dest) const {
+    for (const auto def : defs) {
+        print(names, dest, def);
+        dest << std::endl << std::endl;
     }
 }
 
-// ## Const
-
-Const::Const(Span sp) : Expr(sp) {}
+void Program::print(Names const& names, std::ostream& dest, Expr expr) const {
+    switch (expr.tag()) {
+    case ExprTag::BLOCK: {
+        Block const& block = blocks[expr.index()];
 
-// ## Id
+        dest << "{\n";
 
-Id::Id(Span span, Name n) : Expr(span), name(n) {}
+        for (Stmt const stmt : stmts(block.stmts)) {
+            dest << "        ";
+            print(names, dest, stmt);
+            dest << ";\n";
+        }
 
-void Id::print(Names const& names, std::ostream& dest) const { name.print(names, dest); }
+        dest << "        ";
+        print(names, dest, block.body);
 
-// ## Int
+        dest << "\n    }";
+        break;
+    }
 
-Int::Int(Span span, const char* chars, std::size_t size) : Const(span), digits(strndup(chars, size)) {}
+    case ExprTag::IF: {
+        If const& if_ = ifs[expr.index()];
+
+        dest << "if ";
+        print(names, dest, if_.cond);
+        dest << " {\n        ";
+        print(names, dest, if_.conseq);
+        dest << "\n    } else {\n        ";
+        print(names, dest, if_.alt);
+        dest << "\n    }";
+        break;
+    }
 
-void Int::print(Names const&, std::ostream& dest) const { dest << digits; }
+    case ExprTag::CALL: {
+        Call const& call = calls[expr.index()];
 
-// # Statements
+        print(names, dest, call.callee);
+        print_args(names, dest, call.args);
+        break;
+    }
 
-// ## Val
+    case ExprTag::PRIM_APP: {
+        PrimApp const& prim_app = prim_apps[expr.index()];
 
-void Val::print(const Names &names, std::ostream &dest) const {
-    dest << "val ";
-    pat->print(names, dest);
-    dest << " = ";
-    val_expr->print(names, dest);
-}
+        PrimApp::print_op(prim_app.op, dest);
+        print_args(names, dest, prim_app.args);
+        break;
+    }
 
-// # Def
+    case ExprTag::ID: ids[expr.index()].name.print(names, dest); break;
 
-Def::Def(Span span_) : span(span_) {}
+    case ExprTag::BOOL: dest << (bools[expr.index()].value ? "True" : "False"); break;
 
-// ## FunDef
+    case ExprTag::INT: dest << ints[expr.index()].value; break;
 
-void FunDef::print(Names const& names, std::ostream& dest) const {
-    dest << "fun ";
-    name.print(names, dest);
+    case ExprTag::COUNT: assert(false); // unreachable
+    }
+}
 
-    dest << " (";
+void Program::print_args(Names const& names, std::ostream& dest, Range args) const {
+    dest << '(';
 
-    auto param = params.begin();
-    if (param != params.end()) {
-        (*param)->print(names, dest);
-        ++param;
+    std::span<Expr const> const arg_exprs = exprs(args);
+    auto arg = arg_exprs.begin();
+    if (arg != arg_exprs.end()) {
+        print(names, dest, *arg);
+        ++arg;
 
-        for (; param != params.end(); ++param) {
+        for (; arg != arg_exprs.end(); ++arg) {
             dest << ", ";
-            (*param)->print(names, dest);
+            print(names, dest, *arg);
         }
     }
 
-    dest << ") : ";
+    dest << ')';
+}
+
+void Program::print(Names const& names, std::ostream& dest, Pat pat) const {
+    switch (pat.tag()) {
+    case PatTag::ID: id_pats[pat.index()].name.print(names, dest); break;
+
+    case PatTag::ANN: {
+        AnnPat const& ann_pat = ann_pats[pat.index()];
 
-    codomain->print(names, dest);
+        print(names, dest, ann_pat.pat);
+        dest << " : ";
+        ann_pat.type->print(names, dest);
+        break;
+    }
 
-    dest << " {" << std::endl;
+    case PatTag::COUNT: assert(false); // unreachable
+    }
+}
 
-    dest << "    ";
-    body->print(names, dest);
+void Program::print(Names const& names, std::ostream& dest, Stmt stmt) const {
+    switch (stmt.tag()) {
+    case StmtTag::VAL: {
+        Val const& val = vals[stmt.index()];
 
-    dest << std::endl << '}';
+        dest << "val ";
+        print(names, dest, val.pat);
+        dest << " = ";
+        print(names, dest, val.val_expr);
+        break;
+    }
+
+    case StmtTag::COUNT: assert(false); // unreachable
+    }
 }
 
-// # Program
+void Program::print(Names const& names, std::ostream& dest, Def def) const {
+    switch (def.tag()) {
+    case DefTag::FUN: {
+        FunDef const& fun_def = fun_defs[def.index()];
 
-Program::Program(std::vector<Def*>&& defs_) : defs(std::move(defs_)) {}
+        dest << "fun ";
+        fun_def.name.print(names, dest);
 
-void Program::print(Names const& names, std::ostream& dest) const {
-    for (const auto def : defs) {
-        def->print(names, dest);
-        dest << std::endl << std::endl;
+        dest << " (";
+
+        std::span<Pat const> const params = pats(fun_def.params);
+        auto param = params.begin();
+        if (param != params.end()) {
+            print(names, dest, *param);
+            ++param;
+
+            for (; param != params.end(); ++param) {
+                dest << ", ";
+                print(names, dest, *param);
+            }
+        }
+
+        dest << ") : ";
+
+        fun_def.codomain->print(names, dest);
+
+        dest << " {" << std::endl;
+
+        dest << "    ";
+        print(names, dest, fun_def.body);
+
+        dest << std::endl << '}';
+        break;
+    }
+
+    case DefTag::COUNT: assert(false); // unreachable
     }
 }
 
-} // namespace brmh
+} // namespace brmh::ast
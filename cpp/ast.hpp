@@ -1,8 +1,16 @@
 #ifndef BRMH_AST_HPP
 #define BRMH_AST_HPP
 
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "bumparena.hpp"
 #include "span.hpp"
 #include "name.hpp"
 #include "type.hpp"
@@ -11,237 +19,353 @@
 
 namespace brmh::ast {
 
-struct Stmt;
+// The AST is data-oriented: nodes are plain structs in typed pools of their `Program` and refer to each other with
+// 32-bit `Ref`:s. A `Ref` carries the tag of the pool to index into so that passes dispatch on it with a `switch`
+// instead of virtual calls. The pools are paged into the arena of the `Program`, so the whole AST is still freed at
+// once with it.
 
-// # Exprs
+// # Refs
 
-struct Expr {
-    explicit Expr(Span span);
+template<typename Tag>
+struct Ref {
+    static constexpr unsigned TAG_BITS = 3;
+    static constexpr std::uint32_t MAX_INDEX = (std::uint32_t(1) << (32 - TAG_BITS)) - 1;
 
-    virtual fast::Expr* type_of(fast::Program& program, TypeEnv& env) const = 0;
-    fast::Expr* check(fast::Program& program, TypeEnv& env, type::Type* type) const;
+    Ref(Tag tag, std::uint32_t index) : bits_((index << TAG_BITS) | static_cast<std::uint32_t>(tag)) {}
 
-    virtual void print(Names const& names, std::ostream& dest) const = 0;
+    Tag tag() const { return static_cast<Tag>(bits_ & ((1 << TAG_BITS) - 1)); }
+    std::uint32_t index() const { return bits_ >> TAG_BITS; }
 
-    Span span;
+private:
+    std::uint32_t bits_;
 };
 
-struct Block : public Expr {
-    std::vector<Stmt*> stmts;
-    Expr* body;
+enum struct ExprTag : std::uint8_t { BLOCK, IF, CALL, PRIM_APP, ID, BOOL, INT, COUNT };
+enum struct PatTag : std::uint8_t { ID, ANN, COUNT };
+enum struct StmtTag : std::uint8_t { VAL, COUNT };
+enum struct DefTag : std::uint8_t { FUN, COUNT };
 
-    Block(Span span, std::vector<Stmt*>&& stmts_, Expr* body_)
-        : Expr(span), stmts(stmts_), body(body_) {}
+using Expr = Ref<ExprTag>;
+using Pat = Ref<PatTag>;
+using Stmt = Ref<StmtTag>;
+using Def = Ref<DefTag>;
 
-    virtual fast::Expr* type_of(fast::Program& program, TypeEnv& env) const override;
+// # Pools
 
-    virtual void print(Names const& names, std::ostream& dest) const override;
-};
+// Append-only array of trivial `T`:s in fixed-size pages from a `BumpArena`. Growing never copies (a vector in an arena
+// would leave all of its old buffers behind) and `splice` takes over the pages of another pool, leaving the indices
+// into it shifted by a whole number of pages.
+template<typename T>
+class Pool {
+    static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>);
 
-struct If : public Expr {
-    Expr* cond;
-    Block* conseq;
-    Block* alt;
+public:
+    static constexpr unsigned PAGE_BITS = 8;
+    static constexpr std::uint32_t PAGE_SIZE = std::uint32_t(1) << PAGE_BITS;
 
-    If(Span span, Expr* cond, Block* conseq, Block* alt);
+    Pool() : pages_(), size_(0) {}
 
-    virtual fast::Expr* type_of(fast::Program& program, TypeEnv& env) const override;
+    Pool(Pool&& other) : pages_(std::move(other.pages_)), size_(std::exchange(other.size_, 0)) { other.pages_.clear(); }
 
-    virtual void print(Names const& names, std::ostream& dest) const override;
-};
+    Pool& operator=(Pool&& other) {
+        pages_ = std::move(other.pages_);
+        other.pages_.clear();
+        size_ = std::exchange(other.size_, 0);
+        return *this;
+    }
+
+    // One past the last index in use. Indices below it that a `splice` or `append` skipped over are never handed out:
+    std::uint32_t size() const { return size_; }
+
+    T& operator[](std::uint32_t index) { return pages_[index >> PAGE_BITS][index & (PAGE_SIZE - 1)]; }
+    T const& operator[](std::uint32_t index) const { return pages_[index >> PAGE_BITS][index & (PAGE_SIZE - 1)]; }
+
+    // The `count` items from `start`, which must have been added by one `append`:
+    std::span<T> items(std::uint32_t start, std::uint32_t count) {
+        return count > 0 ? std::span<T>(&(*this)[start], count) : std::span<T>();
+    }
+    std::span<T const> items(std::uint32_t start, std::uint32_t count) const {
+        return count > 0 ? std::span<T const>(&(*this)[start], count) : std::span<T const>();
+    }
 
-struct Call : public Expr {
-    Expr* callee;
-    std::vector<Expr*> args;
+    // Adds `items` contiguously (starting a new run of consecutive pages if they do not fit in the current one) and
+    // returns the index of the first one:
+    std::uint32_t append(BumpArena& arena, std::span<T const> items) {
+        std::uint32_t const count = static_cast<std::uint32_t>(items.size());
+        if (count == 0) { return size_; }
+
+        std::uint32_t const capacity = static_cast<std::uint32_t>(pages_.size()) << PAGE_BITS;
+        if (count > capacity - size_) {
+            std::uint32_t const page_count = (count + PAGE_SIZE - 1) >> PAGE_BITS;
+            T* const pages = static_cast<T*>(arena.alloc_array<T>(std::size_t(page_count) << PAGE_BITS));
+            for (std::uint32_t i = 0; i < page_count; ++i) { pages_.push_back(pages + (std::size_t(i) << PAGE_BITS)); }
+            size_ = capacity;
+        }
 
-    Call(Span span, Expr* callee_, std::vector<Expr*>&& args_)
-        : Expr(span), callee(callee_), args(std::move(args_)) {}
+        std::uint32_t const start = size_;
+        std::copy(items.begin(), items.end(), pages_[start >> PAGE_BITS] + (start & (PAGE_SIZE - 1)));
+        size_ += count;
+        return start;
+    }
 
-    virtual fast::Expr* type_of(fast::Program& program, TypeEnv& env) const override;
+    // Moves the pages of `other` (which must stay alive in some arena) to the end of this and returns the offset that
+    // its indices need to be shifted by:
+    std::uint32_t splice(Pool&& other) {
+        std::uint32_t const offset = static_cast<std::uint32_t>(pages_.size()) << PAGE_BITS;
+        pages_.insert(pages_.end(), other.pages_.begin(), other.pages_.end());
+        size_ = offset + other.size_;
+        other = Pool();
+        return offset;
+    }
 
-    virtual void print(Names const& names, std::ostream& dest) const override {
-        callee->print(names, dest);
+private:
+    std::vector<T*> pages_;
+    std::uint32_t size_;
+};
 
-        dest << '(';
+// Slice of one of the child list pools of a `Program`:
+struct Range {
+    std::uint32_t start;
+    std::uint32_t count;
+};
 
-        auto arg = args.begin();
-        if (arg != args.end()) {
-            (*arg)->print(names, dest);
-            ++arg;
+// # Exprs
 
-            for (; arg != args.end(); ++arg) {
-                dest << ", ";
-                (*arg)->print(names, dest);
-            }
-        }
+struct Block {
+    Span span;
+    Range stmts;
+    Expr body;
+};
 
-        dest << ')';
-    }
+struct If {
+    Span span;
+    Expr cond;
+    Expr conseq; // BLOCK
+    Expr alt; // BLOCK
+};
+
+struct Call {
+    Span span;
+    Expr callee;
+    Range args;
 };
 
-struct PrimApp : public Expr {
-    enum struct Op {
+struct PrimApp {
+    enum struct Op : std::uint8_t {
         ADD_W_I64, SUB_W_I64, MUL_W_I64,
         EQ_I64
     };
 
-    PrimApp(Span span, Op op, std::vector<Expr*>&& args);
-
-    virtual fast::Expr* type_of(fast::Program& program, TypeEnv& env) const override;
-
-    virtual void print(Names const& names, std::ostream& dest) const override;
+    static void print_op(Op op, std::ostream& dest);
 
+    Span span;
     Op op;
-    std::vector<Expr*> args; // OPTIMIZE
+    Range args;
+};
 
-private:
-    static void print_op(Op op, std::ostream& dest);
+struct Id {
+    Span span;
+    Name name;
 };
 
-struct Id : public Expr {
-    Id(Span pos, Name name);
+struct Bool {
+    Span span;
+    bool value;
+};
 
-    virtual fast::Expr* type_of(fast::Program& program, TypeEnv& env) const override;
+struct Int {
+    Span span;
+    std::int64_t value;
+};
 
-    virtual void print(Names const& names, std::ostream& dest) const override;
+// # Patterns
 
+struct IdPat {
+    Span span;
     Name name;
 };
 
-struct Const : public Expr {
-    explicit Const(Span span);
+struct AnnPat {
+    Span span;
+    Pat pat;
+    type::Type* type;
 };
 
-struct Bool : public Const {
-    Bool(Span span, bool v) : Const(span), value(v) {}
+// # Statements
 
-    virtual fast::Expr* type_of(fast::Program& program, TypeEnv& env) const override;
+struct Val {
+    Span span;
+    Pat pat;
+    Expr val_expr;
+};
 
-    virtual void print(Names const&, std::ostream& dest) const override {
-        dest << (value ? "True" : "False");
-    }
+// # Defs
 
-    bool value;
+struct FunDef {
+    Span span;
+    Name name;
+    Range params;
+    type::Type* codomain;
+    Expr body; // BLOCK
 };
 
-struct Int : public Const {
-    Int(Span pos, const char* chars, std::size_t size);
+// # Program
 
-    virtual fast::Expr* type_of(fast::Program& program, TypeEnv& env) const override;
+struct Program {
+    // ## Construction
 
-    virtual void print(Names const& names, std::ostream& dest) const override;
+    Expr block(Span span, Range stmts, Expr body) { return push(ExprTag::BLOCK, blocks, Block {span, stmts, body}); }
 
-    const char* digits;
-};
+    Expr if_(Span span, Expr cond, Expr conseq, Expr alt) {
+        return push(ExprTag::IF, ifs, If {span, cond, conseq, alt});
+    }
 
-// # Patterns
+    Expr call(Span span, Expr callee, Range args) { return push(ExprTag::CALL, calls, Call {span, callee, args}); }
 
-struct Pat {
-    Span span;
+    Expr prim_app(Span span, PrimApp::Op op, Range args) {
+        return push(ExprTag::PRIM_APP, prim_apps, PrimApp {span, op, args});
+    }
 
-    explicit Pat(Span span_) : span(span_) {}
+    Expr id(Span span, Name name) { return push(ExprTag::ID, ids, Id {span, name}); }
+    Expr const_bool(Span span, bool value) { return push(ExprTag::BOOL, bools, Bool {span, value}); }
+    Expr const_int(Span span, std::int64_t value) { return push(ExprTag::INT, ints, Int {span, value}); }
 
-    virtual void print(Names const& names, std::ostream& dest) const = 0;
+    Pat id_pat(Span span, Name name) { return push(PatTag::ID, id_pats, IdPat {span, name}); }
+    Pat ann_pat(Span span, Pat pat, type::Type* type) { return push(PatTag::ANN, ann_pats, AnnPat {span, pat, type}); }
 
-    virtual fast::Pat* type_of(fast::Program& program, TypeEnv& env) const = 0;
-    fast::Pat* check(fast::Program& program, TypeEnv& env, type::Type* type) const;
-};
+    Stmt val(Span span, Pat pat, Expr val_expr) { return push(StmtTag::VAL, vals, Val {span, pat, val_expr}); }
 
-// ## IdPat
+    Def fun_def(Span span, Name name, Range params, type::Type* codomain, Expr body) {
+        return push(DefTag::FUN, fun_defs, FunDef {span, name, params, codomain, body});
+    }
 
-struct IdPat : public Pat {
-    Name name;
+    Range exprs(std::span<Expr const> exprs) { return push_list(expr_lists, exprs); }
+    Range stmts(std::span<Stmt const> stmts) { return push_list(stmt_lists, stmts); }
+    Range pats(std::span<Pat const> pats) { return push_list(pat_lists, pats); }
 
-    IdPat(Span span, Name name_) : Pat(span), name(name_) {}
+    void push_toplevel(Def def) { defs.push_back(def); }
 
-    virtual void print(Names const& names, std::ostream& dest) const override { name.print(names, dest); }
+    // Concatenate separately parsed files, in order:
+    static Program merge(std::vector<Program>&& programs);
 
-    virtual fast::Pat* type_of(fast::Program& program, TypeEnv& env) const override;
-};
+    // ## Access
 
-// ## AnnPat
+    std::span<Expr const> exprs(Range range) const { return expr_lists.items(range.start, range.count); }
+    std::span<Stmt const> stmts(Range range) const { return stmt_lists.items(range.start, range.count); }
+    std::span<Pat const> pats(Range range) const { return pat_lists.items(range.start, range.count); }
 
-struct AnnPat : public Pat {
-    Pat* pat;
-    type::Type* type;
+    Span span(Expr expr) const;
+    Span span(Pat pat) const;
 
-    AnnPat(Span span, Pat* pat_, type::Type* type_) : Pat(span), pat(pat_), type(type_) {}
+    // ## Call Graph
 
-    virtual void print(Names const& names, std::ostream& dest) const override {
-        pat->print(names, dest);
-        dest << " : ";
-        type->print(names, dest);
-    }
+    // The strongly connected components of the graph of references between `defs`, callees first:
+    struct DefComponents {
+        struct Component {
+            Range defs; // Into `defs` below
+            Range callees; // Into `callees` below
+        };
 
-    virtual fast::Pat* type_of(fast::Program& program, TypeEnv& env) const override;
-};
+        std::vector<std::uint32_t> defs; // Indices into `Program::defs`, component by component
+        std::vector<std::uint32_t> callees; // Indices of the (earlier) components that a component refers to, once each
+        std::vector<Component> components;
+    };
 
-// # Statements
+    DefComponents def_components() const;
 
-struct Stmt {
-    Span span;
+    // ## Passes
 
-    explicit Stmt(Span span_) : span(span_) {}
+    // Checks independent components on up to `jobs` threads:
+    fast::Program check(Names& names, type::Types& types, std::size_t jobs) const;
 
-    virtual void print(Names const& names, std::ostream& dest) const = 0;
+    // Recursive, unlike the parser and `check` (see `fast::Program::print`):
+    void print(Names const& names, std::ostream& dest) const;
 
-    virtual std::pair<fast::Stmt*, TypeEnv> check(fast::Program& program, TypeEnv& env) const = 0;
-};
+    // Of all the arenas, including absorbed ones:
+    BumpArena::Stats arena_stats() const;
 
-// ## Val
+    // ## Pools
 
-struct Val : public Stmt {
-    Pat* pat;
-    Expr* val_expr;
+    std::vector<Def> defs;
 
-    Val(Span span, Pat* pat_, Expr* val_expr_)
-        : Stmt(span), pat(pat_), val_expr(val_expr_) {}
+    Pool<Block> blocks;
+    Pool<If> ifs;
+    Pool<Call> calls;
+    Pool<PrimApp> prim_apps;
+    Pool<Id> ids;
+    Pool<Bool> bools;
+    Pool<Int> ints;
 
-    virtual void print(Names const& names, std::ostream& dest) const override;
+    Pool<IdPat> id_pats;
+    Pool<AnnPat> ann_pats;
 
-    virtual std::pair<fast::Stmt*, TypeEnv> check(fast::Program& program, TypeEnv& env) const override;
-};
+    Pool<Val> vals;
 
-// # Defs
+    Pool<FunDef> fun_defs;
 
-struct Def {
-    explicit Def(Span span);
+    Pool<Expr> expr_lists;
+    Pool<Stmt> stmt_lists;
+    Pool<Pat> pat_lists;
 
-    virtual void declare(TypeEnv& env) = 0;
-    virtual fast::Def* check(fast::Program& program, TypeEnv& env) = 0;
+private:
+    template<typename Tag, typename Node>
+    Ref<Tag> push(Tag tag, Pool<Node>& pool, Node node) {
+        std::uint32_t const index = pool.append(arena_, std::span<Node const>(&node, 1));
+        assert(index <= Ref<Tag>::MAX_INDEX);
+        return Ref<Tag>(tag, index);
+    }
 
-    virtual void print(Names const& names, std::ostream& dest) const = 0;
+    template<typename T>
+    Range push_list(Pool<T>& pool, std::span<T const> items) {
+        return Range {pool.append(arena_, items), static_cast<std::uint32_t>(items.size())};
+    }
 
-    Span span;
-};
+    // Pool sizes of a `Program` that another one is being appended to, in `merge`:
+    struct Offsets {
+        std::array<std::uint32_t, std::size_t(ExprTag::COUNT)> exprs;
+        std::array<std::uint32_t, std::size_t(PatTag::COUNT)> pats;
+        std::array<std::uint32_t, std::size_t(StmtTag::COUNT)> stmts;
+        std::uint32_t expr_lists;
+        std::uint32_t stmt_lists;
+        std::uint32_t pat_lists;
+
+        template<typename Tag, std::size_t N>
+        static Ref<Tag> rebase(Ref<Tag> ref, std::array<std::uint32_t, N> const& offsets) {
+            return Ref<Tag>(ref.tag(), ref.index() + offsets[std::size_t(ref.tag())]);
+        }
 
-struct FunDef : public Def {
-    Name name;
-    std::vector<Pat*> params;
-    type::Type* codomain;
-    Block* body;
+        Expr operator()(Expr expr) const { return rebase(expr, exprs); }
+        Pat operator()(Pat pat) const { return rebase(pat, pats); }
+        Stmt operator()(Stmt stmt) const { return rebase(stmt, stmts); }
+    };
 
-    FunDef(Span span, Name name_, std::vector<Pat*>&& params_, type::Type* codomain_, Block* body_)
-        : Def(span), name(name_), params(params_), codomain(codomain_), body(body_) {}
+    void append(Program&& other);
 
-    std::vector<type::Type*> domain() const;
+    // ## Typing (in typer.cpp)
 
-    virtual void declare(TypeEnv& env) override;
-    virtual fast::Def* check(fast::Program& program, TypeEnv& env) override;
+    struct Typing;
 
-    virtual void print(Names const& names, std::ostream& dest) const override;
-};
+    fast::Expr* type_of(fast::Program& program, Typing& typing, TypeEnv& env, Expr expr) const;
+    fast::Expr* descend(fast::Program& program, Typing& typing, TypeEnv& env, Expr expr) const;
+    fast::Expr* check(fast::Program& program, Typing& typing, TypeEnv& env, Expr expr, type::Type* type) const;
 
-// # Program
+    fast::Pat* type_of(fast::Program& program, TypeEnv& env, Pat pat) const;
+    fast::Pat* check(fast::Program& program, TypeEnv& env, Pat pat, type::Type* type) const;
 
-struct Program {
-    explicit Program(std::vector<Def*>&& defs);
+    void declare(TypeEnv& env, Def def) const;
+    fast::Def* check(fast::Program& program, Typing& typing, TypeEnv& env, Def def) const;
+    void generalize(TypeEnv& env, Def def, fast::Def* typed_def) const;
 
-    fast::Program check(Names& names, type::Types& types);
+    // ## Printing
 
-    void print(Names const& names, std::ostream& dest) const;
+    void print(Names const& names, std::ostream& dest, Expr expr) const;
+    void print_args(Names const& names, std::ostream& dest, Range args) const;
+    void print(Names const& names, std::ostream& dest, Pat pat) const;
+    void print(Names const& names, std::ostream& dest, Stmt stmt) const;
+    void print(Names const& names, std::ostream& dest, Def def) const;
 
-    std::vector<Def*> defs;
+    BumpArena arena_; // Backs the pools
+    std::vector<BumpArena> absorbed_; // Of merged `Program`:s, whose pool pages were spliced onto ours
 };
 
 } // namespace brmh::ast
@@ -1,43 +1,70 @@
 #include "bumparena.hpp"
 
-namespace brmh {
+#include <utility>
 
-BumpArena::BumpArena() : bumpers_(), current_() {}
+namespace brmh {
 
-BumpArena::Bumper::Bumper() {
-    start = new char[SIZE];
-    free = start + SIZE;
-}
+BumpArena::BumpArena() : chunks_(), used_chunks_(0), oversized_(), start_(nullptr), free_(nullptr), stats_() {}
 
-BumpArena::Bumper::Bumper(Bumper&& bumper) : start(bumper.start), free(bumper.free) {
-    bumper.start = nullptr;
+BumpArena::BumpArena(BumpArena&& other)
+    : chunks_(std::move(other.chunks_)),
+      used_chunks_(std::exchange(other.used_chunks_, 0)),
+      oversized_(std::move(other.oversized_)),
+      start_(std::exchange(other.start_, nullptr)),
+      free_(std::exchange(other.free_, nullptr)),
+      stats_(std::exchange(other.stats_, Stats()))
+{
+    other.chunks_.clear();
+    other.oversized_.clear();
 }
 
-BumpArena::Bumper& BumpArena::Bumper::operator=(Bumper&& bumper) {
-    start = bumper.start;
-    free = bumper.free;
-    bumper.start = nullptr;
+BumpArena& BumpArena::operator=(BumpArena&& other) {
+    if (this != &other) {
+        chunks_ = std::move(other.chunks_);
+        other.chunks_.clear();
+        used_chunks_ = std::exchange(other.used_chunks_, 0);
+        oversized_ = std::move(other.oversized_);
+        other.oversized_.clear();
+        start_ = std::exchange(other.start_, nullptr);
+        free_ = std::exchange(other.free_, nullptr);
+        stats_ = std::exchange(other.stats_, Stats());
+    }
     return *this;
 }
 
-BumpArena::Bumper::~Bumper() {
-    delete[] start;
-}
+void* BumpArena::alloc_slow(std::size_t size, std::size_t align) {
+    // Enough for `size` bytes at any alignment of the chunk start:
+    std::size_t padded_size;
+    if (__builtin_add_overflow(size, align - 1, &padded_size)) { throw std::bad_alloc(); }
 
-void* BumpArena::Bumper::alloc(std::size_t size) {
-    std::size_t address = reinterpret_cast<std::size_t>(free);
-    // FIXME: `usubl` not right for arbitrary arch:
-    if (__builtin_usubl_overflow(address, size, &address)) { // Bump
-        return nullptr; // Overflow due to huge `size`
-    }
-    address &= ~(alignof(max_align_t) - 1); // Round down for alignment
-
-    char* ptr = reinterpret_cast<char*>(address);
-    if (ptr < start) {
-        return nullptr; // Did not fit
+    std::size_t const regular_size = chunk_size(used_chunks_);
+    if (padded_size > regular_size) {
+        // Dedicated chunk, leaving the current one in use:
+        char* const chunk = oversized_.emplace_back(new char[padded_size]).get();
+        std::uintptr_t const end = reinterpret_cast<std::uintptr_t>(chunk + padded_size);
+        std::uintptr_t const address = (end - size) & ~(std::uintptr_t(align) - 1);
+        stats_.requested += size;
+        stats_.alignment_waste += (end - size) - address;
+        ++stats_.chunks;
+        stats_.chunk_bytes += padded_size;
+        return reinterpret_cast<char*>(address);
     } else {
-        return free = ptr;
+        if (used_chunks_ == chunks_.size()) {
+            chunks_.emplace_back(new char[regular_size]);
+            ++stats_.chunks;
+            stats_.chunk_bytes += regular_size;
+        }
+        start_ = chunks_[used_chunks_++].get();
+        free_ = start_ + regular_size;
+        return alloc(size, align); // Fits now
     }
 }
 
+void BumpArena::rewind(Mark const& mark) {
+    used_chunks_ = mark.used_chunks_;
+    oversized_.resize(mark.oversized_count_);
+    start_ = mark.start_;
+    free_ = mark.free_;
+}
+
 } // namespace brmh
@@ -2,61 +2,154 @@
 #define BRMH_BUMPARENA_HPP
 
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace brmh {
 
+// Region allocator: `alloc` hands out memory from chunks, all of which are only freed with the arena. Chunks start
+// small, since many arenas only ever hold a few nodes, and double in size up to 1 MiB. Requests that would not fit in
+// a regular chunk get a dedicated one.
+//
+// A `Mark` rewinds the arena when it goes out of scope, so a pass can put its scratch data in an arena that outlives
+// it and free all of it at once.
 struct BumpArena {
+    // Rewinds the arena to where it was when the mark was created, freeing everything allocated since. Regular chunks
+    // are kept for reuse. Marks of the same arena must be destroyed in the reverse order of creation:
+    class Mark {
+    public:
+        explicit Mark(BumpArena& arena)
+            : arena_(arena), used_chunks_(arena.used_chunks_), oversized_count_(arena.oversized_.size()),
+              start_(arena.start_), free_(arena.free_) {}
+
+        ~Mark() { arena_.rewind(*this); }
+
+        Mark(Mark const&) = delete;
+        Mark& operator=(Mark const&) = delete;
+
+    private:
+        friend struct BumpArena;
+
+        BumpArena& arena_;
+        std::size_t used_chunks_;
+        std::size_t oversized_count_;
+        char* start_;
+        char* free_;
+    };
+
+    // Cumulative counters, for `--mem-report`. Rewinding does not reset them:
+    struct Stats {
+        std::size_t requested; // Bytes asked for with `alloc`
+        std::size_t alignment_waste; // Padding inserted below allocations to align them
+        std::size_t chunks; // Chunks allocated from the heap, including oversized ones
+        std::size_t chunk_bytes; // Total size of those chunks
+
+        // For reporting a group of arenas:
+        Stats& operator+=(Stats const& other) {
+            requested += other.requested;
+            alignment_waste += other.alignment_waste;
+            chunks += other.chunks;
+            chunk_bytes += other.chunk_bytes;
+            return *this;
+        }
+    };
+
     BumpArena();
 
+    BumpArena(BumpArena&& other);
+    BumpArena& operator=(BumpArena&& other);
+
+    BumpArena(BumpArena const&) = delete;
+    BumpArena& operator=(BumpArena const&) = delete;
+
     template<class T>
-    void* alloc() {
-        void* allocation = current_.alloc(sizeof(T));
-        if (allocation) {
-            return allocation;
-        } else {
-            bumpers_.push_back(std::move(current_));
-            current_ = Bumper();
-            return current_.alloc(sizeof(T));
-        }
-    }
+    void* alloc() { return alloc(sizeof(T), alignof(T)); }
 
     template<class T>
     void* alloc_array(std::size_t count) {
-        const std::size_t size = sizeof(T) * count;
-        void* allocation = current_.alloc(size);
-        if (allocation) {
-            return allocation;
-        } else {
-            bumpers_.push_back(std::move(current_));
-            current_ = Bumper();
-            return current_.alloc(size);
+        std::size_t size;
+        if (__builtin_mul_overflow(sizeof(T), count, &size)) { throw std::bad_alloc(); }
+        return alloc(size, alignof(T));
+    }
+
+    // `align` must be a power of two:
+    void* alloc(std::size_t size, std::size_t align) {
+        // Bump down so that aligning is just masking off low bits:
+        std::uintptr_t const free = reinterpret_cast<std::uintptr_t>(free_);
+        std::uintptr_t const start = reinterpret_cast<std::uintptr_t>(start_);
+        if (size <= free - start) {
+            std::uintptr_t const address = (free - size) & ~(std::uintptr_t(align) - 1);
+            if (address >= start) {
+                stats_.requested += size;
+                stats_.alignment_waste += (free - size) - address;
+                free_ = reinterpret_cast<char*>(address);
+                return free_;
+            }
         }
+
+        return alloc_slow(size, align);
     }
 
+    Stats const& stats() const { return stats_; }
+
 private:
-    struct Bumper {
-        static const std::size_t SIZE = 1 << 20; // 1 MiB
+    static constexpr std::size_t MIN_CHUNK_SIZE = 1 << 12; // 4 KiB
+    static constexpr std::size_t MAX_CHUNK_SIZE = 1 << 20; // 1 MiB
+    static constexpr std::size_t GROWTH_STEPS = 8;
+    static_assert(MIN_CHUNK_SIZE << GROWTH_STEPS == MAX_CHUNK_SIZE);
 
-        Bumper();
-        ~Bumper();
+    // Size of `chunks_[index]`:
+    static std::size_t chunk_size(std::size_t index) {
+        return index < GROWTH_STEPS ? MIN_CHUNK_SIZE << index : MAX_CHUNK_SIZE;
+    }
 
-        Bumper(Bumper&& bumper);
-        Bumper& operator=(Bumper&& bumper);
+    void* alloc_slow(std::size_t size, std::size_t align);
 
-        Bumper(const Bumper& bumper) = delete;
-        Bumper& operator=(const Bumper& bumper) = delete;
+    void rewind(Mark const& mark);
 
-        void* alloc(std::size_t size);
+    std::vector<std::unique_ptr<char[]>> chunks_; // Regular chunks; the ones after the current one are free
+    std::size_t used_chunks_; // Number of regular chunks in use, including the current one
+    std::vector<std::unique_ptr<char[]>> oversized_;
+    char* start_; // Of the current chunk
+    char* free_; // End of the free space in the current chunk
+    Stats stats_;
+};
 
-        char* start;
-        char* free;
-    };
+// Lets standard containers allocate from a `BumpArena`. Deallocation does nothing; the memory is reclaimed when the
+// arena is rewound or destroyed. Growing a container leaves its old buffer behind, so this suits short-lived scratch
+// data best.
+template<class T>
+struct ArenaAllocator {
+    using value_type = T;
 
-    std::vector<Bumper> bumpers_;
-    Bumper current_;
+    ArenaAllocator(BumpArena& arena_) : arena(&arena_) {}
+
+    template<class U>
+    ArenaAllocator(ArenaAllocator<U> const& other) : arena(other.arena) {}
+
+    T* allocate(std::size_t count) { return static_cast<T*>(arena->alloc_array<T>(count)); }
+    void deallocate(T*, std::size_t) {}
+
+    template<class U>
+    bool operator==(ArenaAllocator<U> const& other) const { return arena == other.arena; }
+
+    BumpArena* arena;
 };
 
+template<class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+template<class K, class V, class Hash = std::hash<K>>
+using ArenaMap = std::unordered_map<K, V, Hash, std::equal_to<K>, ArenaAllocator<std::pair<K const, V>>>;
+
+template<class T, class Hash = std::hash<T>>
+using ArenaSet = std::unordered_set<T, Hash, std::equal_to<T>, ArenaAllocator<T>>;
+
 } // namespace brmh
 
 #endif // BRMH_BUMPARENA_HPP
@@ -2,26 +2,20 @@
 #include "schedule.hpp"
 
 #include <cstring>
+#include <sstream>
+
+#include "../hash.hpp"
 
 namespace brmh::cps {
 
-void Fn::print_def(Names const& names, std::ostream& dest) const {
-    doms::DomTree const doms = doms::DomTree::of(this);
-
-    schedule::Schedule const schedule = schedule::schedule_late(this, doms);
-    std::unordered_map<Block const*, std::vector<Expr const*>> block_exprs;
-    for (auto expr_block : schedule) {
-        Expr const* const expr = expr_block.first;
-        Block const* const block = expr_block.second;
-        auto it = block_exprs.find(block);
-        if (it != block_exprs.end()) {
-            it->second.push_back(expr);
-        } else {
-            block_exprs.insert({block, {expr}});
-        }
-    }
+void Fn::print_def(Names const& names, std::ostream& dest, BumpArena& arena) const {
+    BumpArena::Mark const mark(arena);
+
+    doms::DomTree const doms = doms::DomTree::of(this, arena);
+
+    schedule::Schedule block_exprs = schedule::schedule_late(this, doms, arena);
 
-    std::unordered_set<Expr const*> visited_exprs;
+    ArenaSet<Expr const*> visited_exprs(arena);
 
     PrintCtx ctx(names, std::move(block_exprs), std::move(visited_exprs));
 
@@ -50,6 +44,44 @@ void Fn::print_def(Names const& names, std::ostream& dest) const {
     dest << std::endl << '}';
 }
 
+// The visits are read-only, so this casts the `const` away to update the names in place:
+void Fn::keep_names(Names::Compaction& compaction) {
+    struct KeepNames : public TransfersExprsVisitor {
+        Names::Compaction& compaction;
+
+        explicit KeepNames(Names::Compaction& compaction_) : compaction(compaction_) {}
+
+        virtual void visit(Transfer const*) override {}
+
+        virtual void visit(Expr const* expr) override {
+            Expr* const mut_expr = const_cast<Expr*>(expr);
+            compaction.keep(mut_expr->name);
+            mut_expr->type->keep_names(compaction);
+        }
+    };
+
+    compaction.keep(name);
+    type->keep_names(compaction);
+    compaction.keep(ret->name);
+
+    post_visit_blocks([&] (Block const* block) {
+        compaction.keep(const_cast<Block*>(block)->name);
+        for (Param* const param : block->params) { // Unused params are not operands of anything
+            compaction.keep(param->name);
+            param->type->keep_names(compaction);
+        }
+    });
+
+    KeepNames visitor(compaction);
+    post_visit_transfers_and_exprs(visitor);
+}
+
+void Program::keep_names(Names::Compaction& compaction) {
+    for (Fn* const ext_fn : externs) {
+        ext_fn->keep_names(compaction);
+    }
+}
+
 void Call::do_print(Names const& names, std::ostream& dest) const {
     dest << "        call ";
     callee()->name.print(names, dest);
@@ -138,4 +170,62 @@ void Expr::print_in(PrintCtx& ctx, std::ostream& dest) const {
     }
 }
 
+// # Builder
+
+bool Builder::InstanceKey::operator==(InstanceKey const& other) const {
+    return generic == other.generic && std::equal(type_args.begin(), type_args.end(), other.type_args.begin(),
+                                                  other.type_args.end());
+}
+
+std::size_t Builder::InstanceKey::Hash::operator()(InstanceKey const& key) const noexcept {
+    std::uint64_t hash = hash_word(HASH_SEED, Name::Hash()(key.generic));
+    for (type::Type* const arg : key.type_args) {
+        hash = hash_word(hash, reinterpret_cast<std::uintptr_t>(arg));
+    }
+    return hash_finish(hash, key.type_args.size());
+}
+
+Expr* Builder::id(Name name, std::span<type::Type* const> type_args) {
+    auto const generic = generics_.find(name);
+    if (generic == generics_.end()) { return exprs_.at(name); }
+
+    std::span<type::Uv* const> const type_params = generic->second.type_params;
+    type_args_.resize(type_params.size());
+    for (std::size_t i = 0; i < type_params.size(); ++i) {
+        // Even outside of instances, so that the args come out `find`:ed and interned:
+        type_args_[i] = (type_args.empty() ? type_params[i] : type_args[i])->instantiate(types_, 0, subst_);
+    }
+
+    return instance(name, generic->second, type_args_);
+}
+
+Fn* Builder::instance(Name name, Generic const& generic, std::span<type::Type* const> type_args) {
+    auto const it = instances_.find(InstanceKey {name, type_args});
+    if (it != instances_.end()) { return it->second; }
+
+    type::Type** const args = static_cast<type::Type**>(arena_.alloc_array<type::Type*>(type_args.size()));
+    std::copy(type_args.begin(), type_args.end(), args);
+    std::span<type::Type* const> const instance_args(args, type_args.size());
+
+    instance_subst_.params.assign(generic.type_params.begin(), generic.type_params.end());
+    instance_subst_.args.assign(instance_args.begin(), instance_args.end());
+    type::FnType* const type = static_cast<type::FnType*>(generic.type->instantiate(types_, 0, instance_subst_));
+
+    // Named after the type args as well, since LLVM functions are looked up by name:
+    std::ostringstream instance_chars;
+    instance_chars << name.src_name(*names_).unwrap_or("") << '<';
+    for (std::size_t i = 0; i < instance_args.size(); ++i) {
+        if (i > 0) { instance_chars << ", "; }
+        instance_args[i]->print(*names_, instance_chars);
+    }
+    instance_chars << '>';
+    std::string const chars = instance_chars.str();
+    Name const instance_name = names_->fresh(chars.data(), chars.size());
+
+    Fn* const fn = this->fn(generic.span, instance_name, type, true, return_(names_->fresh()), nullptr);
+    instances_.insert({InstanceKey {name, instance_args}, fn});
+    pending_instances_.push_back(Instance {name, fn, instance_args});
+    return fn;
+}
+
 } // namespace brmh::cps
@@ -1,7 +1,9 @@
 #ifndef HOSSA_HPP
 #define HOSSA_HPP
 
+#include <optional>
 #include <span>
+#include <unordered_map>
 #include <unordered_set>
 #include <ostream>
 
@@ -33,13 +35,13 @@ class Builder;
 
 struct PrintCtx {
     Names const& names;
-    std::unordered_map<Block const*, std::vector<Expr const*>> block_exprs;
-    std::unordered_set<Expr const*> visited_exprs;
+    ArenaMap<Block const*, ArenaVector<Expr const*>> block_exprs;
+    ArenaSet<Expr const*> visited_exprs;
 
     PrintCtx(Names const& names_,
-             std::unordered_map<Block const*, std::vector<Expr const*>>&& block_exprs_,
-             std::unordered_set<Expr const*>&& visited_exprs_)
-        : names(names_), block_exprs(block_exprs_), visited_exprs(visited_exprs_) {}
+             ArenaMap<Block const*, ArenaVector<Expr const*>>&& block_exprs_,
+             ArenaSet<Expr const*>&& visited_exprs_)
+        : names(names_), block_exprs(std::move(block_exprs_)), visited_exprs(std::move(visited_exprs_)) {}
 };
 
 struct TransfersExprsVisitor {
@@ -203,17 +205,17 @@ protected:
 // ## I64
 
 struct I64 : public Const {
-    const char* digits;
+    std::int64_t value;
 
 private:
     friend class Builder;
 
-    I64(Span span, Name name, type::Type* type, const char* digits_)
-        : Const(span, name, type), digits(digits_) {}
+    I64(Span span, Name name, type::Type* type, std::int64_t value_)
+        : Const(span, name, type), value(value_) {}
 
 public:
     void do_print(Names const&, std::ostream& dest) const override {
-        dest << digits;
+        dest << value;
     }
 
     virtual llvm::Value* do_to_llvm(ToLLVMCtx& ctx, llvm::IRBuilder<>& builder) const override;
@@ -462,11 +464,14 @@ public:
         name.print(names, dest);
     }
 
-    void print_def(Names const& names, std::ostream& dest) const;
+    // The `arena` is for scratch data and gets rewound before returning:
+    void print_def(Names const& names, std::ostream& dest, BumpArena& arena) const;
 
     virtual llvm::Value* do_to_llvm(ToLLVMCtx& ctx, llvm::IRBuilder<>& builder) const override;
     void llvm_declare(Names const& names, llvm::LLVMContext& llvm_ctx, llvm::Module& module, llvm::Function::LinkageTypes linkage) const;
-    void llvm_define(Names const& names, llvm::LLVMContext& llvm_ctx, llvm::Module& module) const;
+    void llvm_define(Names const& names, llvm::LLVMContext& llvm_ctx, llvm::Module& module, BumpArena& arena) const;
+
+    void keep_names(Names::Compaction& compaction);
 };
 
 // # Program
@@ -482,19 +487,61 @@ private:
         : externs(std::move(externs_)), arena_(std::move(arena)) {}
 
 public:
-    void print(Names const& names, std::ostream& dest) const {
+    // The `scratch` arena is only used for per-function temporaries, so it can be shared by passes:
+
+    void print(Names const& names, std::ostream& dest, BumpArena& scratch) const {
         for (Fn* const ext_fn : externs) {
-            ext_fn->print_def(names, dest);
+            ext_fn->print_def(names, dest, scratch);
             dest << std::endl << std::endl;
         }
     }
 
-    void to_llvm(Names const& names, llvm::LLVMContext& llvm_ctx, llvm::Module& module) const;
+    void to_llvm(Names const& names, llvm::LLVMContext& llvm_ctx, llvm::Module& module, BumpArena& scratch) const;
+
+    BumpArena const& arena() const { return arena_; }
+
+    // Keeps every name in the program and its types, for a `Names::Compaction`:
+    void keep_names(Names::Compaction& compaction);
 };
 
 // # Builder
 
 class Builder {
+public:
+    // Specialization of a polymorphic function, to be built with its `type_args`:
+    struct Instance {
+        Name generic;
+        Fn* fn;
+        std::span<type::Type* const> type_args;
+    };
+
+private:
+    struct Generic {
+        Span span;
+        type::FnType* type;
+        std::span<type::Uv* const> type_params;
+    };
+
+    // The type args are ground (barring ambiguous types) and thus interned, so comparing their pointers suffices:
+    struct InstanceKey {
+        Name generic;
+        std::span<type::Type* const> type_args;
+
+        bool operator==(InstanceKey const& other) const;
+
+        struct Hash {
+            using is_transparent = void;
+
+            std::size_t operator()(InstanceKey const& key) const noexcept;
+        };
+
+        struct Eq {
+            using is_transparent = void;
+
+            bool operator()(InstanceKey const& key, InstanceKey const& other) const { return key == other; }
+        };
+    };
+
     Names* names_;
     type::Types& types_;
     BumpArena arena_;
@@ -502,11 +549,23 @@ class Builder {
     std::vector<Fn*> externs_;
     opt_ptr<Block> current_block_;
 
+    std::unordered_map<Name, Generic, Name::Hash> generics_;
+    std::unordered_map<InstanceKey, Fn*, InstanceKey::Hash, InstanceKey::Eq> instances_;
+    std::vector<Instance> pending_instances_; // Declared but not built yet, from `next_pending_` on
+    std::size_t next_pending_;
+    type::Substitution subst_; // Of the instance being built, if any
+    type::Substitution instance_subst_; // Scratch for `instance`
+    std::vector<type::Type*> type_args_; // Scratch for `id`
+
+    Fn* instance(Name name, Generic const& generic, std::span<type::Type* const> type_args);
+
 public:
     Builder(Names* names, type::Types& types)
         : names_(names), types_(types), arena_(),
           exprs_(), externs_(),
-          current_block_(opt_ptr<Block>::none()) {}
+          current_block_(opt_ptr<Block>::none()),
+          generics_(), instances_(), pending_instances_(), next_pending_(0), subst_(), instance_subst_(),
+          type_args_() {}
 
     Names *names() const { return names_; }
 
@@ -516,7 +575,33 @@ public:
 
     void set_current_block(Block* block) { current_block_ = opt_ptr<Block>::some(block); }
 
-    void define(Name name, Expr* expr) { exprs_.insert({name, expr}); }
+    // Instances of a polymorphic function reuse its local names, so this replaces the previous definition:
+    void define(Name name, Expr* expr) { exprs_.insert_or_assign(name, expr); }
+
+    // ## Monomorphization
+
+    // Polymorphic functions are only registered here. Each distinct instance of them that gets referenced is declared
+    // once, and queued for `next_instance`:
+    void generic(Span span, Name name, type::FnType* type, std::span<type::Uv* const> type_params) {
+        generics_.insert({name, Generic {span, type, type_params}});
+    }
+
+    std::optional<Instance> next_instance() {
+        if (next_pending_ == pending_instances_.size()) { return std::optional<Instance>(); }
+        return pending_instances_[next_pending_++];
+    }
+
+    // Until `end_specialization`, the types given to the builder get `type_params` replaced with `type_args`:
+    void specialize(std::span<type::Uv* const> type_params, std::span<type::Type* const> type_args) {
+        subst_.params.assign(type_params.begin(), type_params.end());
+        subst_.args.assign(type_args.begin(), type_args.end());
+    }
+
+    void end_specialization() { subst_.clear(); }
+
+    type::Type* specialized(type::Type* type) {
+        return subst_.params.empty() ? type : type->instantiate(types_, 0, subst_);
+    }
 
     // OPTIMIZE: deduplicate constants, constant folding, CSE etc.:
 
@@ -537,7 +622,7 @@ public:
     Return* return_(Name name) { return new (arena_.alloc<Return>()) Return(name); }
 
     Param* param(Span span, type::Type* type, Block* block_, Name name, std::size_t index) {
-        Param* const param = new (arena_.alloc<Param>()) Param(span, name, type);
+        Param* const param = new (arena_.alloc<Param>()) Param(span, name, specialized(type));
 
         block_->params[index] = param;
 
@@ -563,31 +648,31 @@ public:
     }
 
     Expr* add_w_i64(Span span, Name name, type::Type* type, std::array<Expr*, 2> args) {
-        return new (arena_.alloc<AddWI64>()) AddWI64(span, name, type, args);
+        return new (arena_.alloc<AddWI64>()) AddWI64(span, name, specialized(type), args);
     }
 
     Expr* sub_w_i64(Span span, Name name, type::Type* type, std::array<Expr*, 2> args) {
-        return new (arena_.alloc<SubWI64>()) SubWI64(span, name, type, args);
+        return new (arena_.alloc<SubWI64>()) SubWI64(span, name, specialized(type), args);
     }
 
     Expr* mul_w_i64(Span span, Name name, type::Type* type, std::array<Expr*, 2> args) {
-        return new (arena_.alloc<MulWI64>()) MulWI64(span, name, type, args);
+        return new (arena_.alloc<MulWI64>()) MulWI64(span, name, specialized(type), args);
     }
 
     Expr* eq_i64(Span span, Name name, type::Type* type, std::array<Expr*, 2> args) {
-        return new (arena_.alloc<EqI64>()) EqI64(span, name, type, args);
+        return new (arena_.alloc<EqI64>()) EqI64(span, name, specialized(type), args);
     }
 
-    Expr* id(Name name) { return exprs_.at(name); }
+    // `type_args` are those of a reference to a polymorphic function; empty for other references and for the
+    // recursive ones of a polymorphic function, which are at its own type parameters:
+    Expr* id(Name name, std::span<type::Type* const> type_args);
 
     Bool *const_bool(Span span, Name name, type::Type *type, bool value) {
-        return new (arena_.alloc<Bool>()) Bool(span, name, type, value);
+        return new (arena_.alloc<Bool>()) Bool(span, name, specialized(type), value);
     }
 
-    I64* const_i64(Span span, Name name, type::Type* type, const char* digits_, std::size_t size) {
-        char* digits = static_cast<char*>(arena_.alloc_array<char>(size));
-        strncpy(digits, digits_, size);
-        return new (arena_.alloc<I64>()) I64(span, name, type, digits);
+    I64* const_i64(Span span, Name name, type::Type* type, std::int64_t value) {
+        return new (arena_.alloc<I64>()) I64(span, name, specialized(type), value);
     }
 
     Program build() { return Program(std::move(arena_), std::move(externs_)); }
@@ -4,7 +4,7 @@
 
 namespace brmh::cps::doms {
 
-using CompactDomTree = std::vector<std::optional<PostIndex>>;
+using CompactDomTree = ArenaVector<std::optional<PostIndex>>;
 
 PostIndex intersect(CompactDomTree const& doms, PostIndex finger1, PostIndex finger2) {
     while (finger1 != finger2) {
@@ -20,10 +20,10 @@ PostIndex intersect(CompactDomTree const& doms, PostIndex finger1, PostIndex fin
     return finger1;
 }
 
-DomTree DomTree::of(Fn const* fn) {
+DomTree DomTree::of(Fn const* fn, BumpArena& arena) {
     // Initialize postorder indices:
-    std::vector<Block const*> post_order;
-    std::unordered_map<Block const*, PostIndex> block_indices;
+    ArenaVector<Block const*> post_order(arena);
+    ArenaMap<Block const*, PostIndex> block_indices(arena);
     fn->post_visit_blocks([&] (Block const* block) {
         std::size_t const i = post_order.size();
         post_order.push_back(block);
@@ -31,7 +31,7 @@ DomTree DomTree::of(Fn const* fn) {
     });
 
     // Initialize predecessors:
-    std::vector<std::vector<PostIndex>> predecessors(post_order.size());
+    ArenaVector<ArenaVector<PostIndex>> predecessors(post_order.size(), ArenaVector<PostIndex>(arena), arena);
     for (PostIndex i = 0; i < post_order.size(); ++i) {
         for (Cont const* succ : post_order[i]->transfer->successors()) {
             succ->as_block().iter([&] (Block const* succ) {
@@ -41,7 +41,7 @@ DomTree DomTree::of(Fn const* fn) {
     }
 
     // Initialize compact dominator tree:
-    CompactDomTree doms(post_order.size());
+    CompactDomTree doms(post_order.size(), arena);
     PostIndex root_index = post_order.size() - 1;
     doms[root_index] = root_index;
 
@@ -51,7 +51,7 @@ DomTree DomTree::of(Fn const* fn) {
         changed = false;
 
         for (PostIndex i = post_order.size(); i-- > 0;) {
-            std::vector<PostIndex>::const_iterator pred = predecessors[i].cbegin();
+            ArenaVector<PostIndex>::const_iterator pred = predecessors[i].cbegin();
 
             for (; pred != predecessors[i].cend() && !doms[*pred].has_value(); ++pred) {}
 
@@ -72,7 +72,7 @@ DomTree DomTree::of(Fn const* fn) {
     }
 
     // Expand dominator tree:
-    DomTreeBuilder builder;
+    DomTreeBuilder builder(arena);
     for (PostIndex i = doms.size(); i-- > 0;) {
         PostIndex const parent_index = doms[i].value();
         opt_ptr<Block const> const parent = parent_index != i ?
@@ -1,9 +1,8 @@
 #ifndef BRMH_HOSSA_DOMS_HPP
 #define BRMH_HOSSA_DOMS_HPP
 
-#include <unordered_map>
-
 #include "../util.hpp"
+#include "../bumparena.hpp"
 #include "cps.hpp"
 
 namespace brmh::cps::doms {
@@ -18,41 +17,32 @@ struct DomTreeNode {
     opt_ptr<DomTreeNode> parent; // Immediate dominator
 
 private:
-    friend class DomTree;
     friend class DomTreeBuilder;
 
     DomTreeNode(Block const* block_, PostIndex post_index_, opt_ptr<DomTreeNode> parent_)
         : block(block_), post_index(post_index_), parent(parent_) {}
-
-    template<typename F>
-    void do_pre_visit(F f, std::unordered_set<DomTreeNode const*>& visited) const {
-        if (!visited.contains(this)) {
-            visited.insert(this);
-            parent.iter([&] (DomTreeNode const* parent) { parent->do_pre_visit(f, visited); });
-            f(this->block);
-        }
-    }
 };
 
 class DomTree {
-    BumpArena arena_;
 public:
-    std::unordered_map<Block const*, DomTreeNode*> block_nodes;
+    ArenaMap<Block const*, DomTreeNode*> block_nodes;
+    ArenaVector<DomTreeNode const*> pre_order; // Reverse postorder, so every dominator precedes the blocks it dominates
 
 private:
     friend class DomTreeBuilder;
 
-    DomTree(BumpArena&& arena, std::unordered_map<Block const*, DomTreeNode*>&& block_nodes_)
-        : arena_(std::move(arena)), block_nodes(std::move(block_nodes_)) {}
+    DomTree(ArenaMap<Block const*, DomTreeNode*>&& block_nodes_, ArenaVector<DomTreeNode const*>&& pre_order_)
+        : block_nodes(std::move(block_nodes_)), pre_order(std::move(pre_order_)) {}
 
 public:
-    static DomTree of(Fn const* fn);
+    // The tree and the temporaries used to build it live in `arena`, so the tree is only valid until the caller
+    // rewinds that:
+    static DomTree of(Fn const* fn, BumpArena& arena);
 
     template<typename F>
     void pre_visit_blocks(F f) const {
-        std::unordered_set<DomTreeNode const*> visited;
-        for (auto kv : block_nodes) {
-            kv.second->do_pre_visit(f, visited);
+        for (DomTreeNode const* node : pre_order) {
+            f(node->block);
         }
     }
 
@@ -60,19 +50,24 @@ public:
 };
 
 class DomTreeBuilder {
-    BumpArena arena_;
-    std::unordered_map<Block const*, DomTreeNode*> block_nodes_;
+    BumpArena& arena_;
+    ArenaMap<Block const*, DomTreeNode*> block_nodes_;
+    ArenaVector<DomTreeNode const*> pre_order_;
 
 public:
+    explicit DomTreeBuilder(BumpArena& arena) : arena_(arena), block_nodes_(arena), pre_order_(arena) {}
+
     void node(Block const* block, PostIndex post_index, opt_ptr<Block const> opt_parent_block) {
         opt_ptr<DomTreeNode> parent = opt_parent_block.map<DomTreeNode>([&] (Block const* parent_block) {
             return block_nodes_.at(parent_block);
         });
         auto node = new (arena_.alloc<DomTreeNode>()) DomTreeNode(block, post_index, parent);
         block_nodes_.insert({block, node});
+        pre_order_.push_back(node);
     }
 
-    DomTree build() { return DomTree(std::move(arena_), std::move(block_nodes_)); }
+    // Expects the nodes in reverse postorder, so that parents come before their children:
+    DomTree build() { return DomTree(std::move(block_nodes_), std::move(pre_order_)); }
 };
 
 }
@@ -5,11 +5,13 @@
 namespace brmh::cps::schedule {
 
 struct SetupVisitor : public cps::TransfersExprsVisitor {
-    std::vector<Expr const*> post_order;
-    std::unordered_map<Expr const*, std::vector<Expr const*>> use_exprs;
-    std::unordered_map<Expr const*, std::vector<Transfer const*>> use_transfers;
+    BumpArena& arena;
+    ArenaVector<Expr const*> post_order;
+    ArenaMap<Expr const*, ArenaVector<Expr const*>> use_exprs;
+    ArenaMap<Expr const*, ArenaVector<Transfer const*>> use_transfers;
 
-    SetupVisitor() : post_order() {}
+    explicit SetupVisitor(BumpArena& arena_)
+        : arena(arena_), post_order(arena_), use_exprs(arena_), use_transfers(arena_) {}
 
     virtual void visit(Transfer const* transfer) override {
         for (Expr const* arg : transfer->operands()) {
@@ -17,7 +19,7 @@ struct SetupVisitor : public cps::TransfersExprsVisitor {
             if (it != use_transfers.end()) {
                 it->second.push_back(transfer);
             } else {
-                use_transfers.insert({arg, {transfer}});
+                use_transfers.insert({arg, ArenaVector<Transfer const*>({transfer}, arena)});
             }
         }
     }
@@ -30,35 +32,35 @@ struct SetupVisitor : public cps::TransfersExprsVisitor {
             if (it != use_exprs.end()) {
                 it->second.push_back(expr);
             } else {
-                use_exprs.insert({arg, {expr}});
+                use_exprs.insert({arg, ArenaVector<Expr const*>({expr}, arena)});
             }
         }
     }
 };
 
-Schedule schedule_late(Fn const* fn, doms::DomTree const& doms) {
+Schedule schedule_late(Fn const* fn, doms::DomTree const& doms, BumpArena& arena) {
     // Initialize postorder and reverse mappings:
 
-    SetupVisitor visitor;
+    SetupVisitor visitor(arena);
     fn->post_visit_transfers_and_exprs(visitor);
-    std::vector<Expr const*> post_order = std::move(visitor.post_order);
-    std::unordered_map<Expr const*, std::vector<Expr const*>> use_exprs = std::move(visitor.use_exprs);
-    std::unordered_map<Expr const*, std::vector<Transfer const*>> use_transfers = std::move(visitor.use_transfers);
+    ArenaVector<Expr const*> const& post_order = visitor.post_order;
+    ArenaMap<Expr const*, ArenaVector<Expr const*>> const& use_exprs = visitor.use_exprs;
+    ArenaMap<Expr const*, ArenaVector<Transfer const*>> const& use_transfers = visitor.use_transfers;
 
-    std::unordered_map<Transfer const*, Block const*> transfer_blocks;
+    ArenaMap<Transfer const*, Block const*> transfer_blocks(arena);
     fn->post_visit_blocks([&] (Block const* block) {
         transfer_blocks.insert({block->transfer, block});
     });
 
     // Schedule in reverse postorder:
-    Schedule res;
+    ArenaMap<Expr const*, Block const*> expr_blocks(arena);
     std::for_each(post_order.crbegin(), post_order.crend(), [&] (Expr const* expr) {
         Block const* parent = nullptr;
 
         auto expr_use_exprs = use_exprs.find(expr);
         if (expr_use_exprs != use_exprs.end()) {
             for (Expr const* use : expr_use_exprs->second) {
-                Block const* const use_parent = res.at(use);
+                Block const* const use_parent = expr_blocks.at(use);
                 if (parent == nullptr) {
                     parent = use_parent;
                 } else {
@@ -79,9 +81,21 @@ Schedule schedule_late(Fn const* fn, doms::DomTree const& doms) {
             }
         }
 
-        res.insert({expr, parent});
+        expr_blocks.insert({expr, parent});
     });
 
+    // Group by block in postorder:
+    Schedule res(arena);
+    for (Expr const* expr : post_order) {
+        Block const* const block = expr_blocks.at(expr);
+        auto it = res.find(block);
+        if (it != res.end()) {
+            it->second.push_back(expr);
+        } else {
+            res.insert({block, ArenaVector<Expr const*>({expr}, arena)});
+        }
+    }
+
     return res;
 }
 
@@ -1,16 +1,17 @@
 #ifndef BRMH_HOSSA_SCHEDULE_HPP
 #define BRMH_HOSSA_SCHEDULE_HPP
 
-#include <unordered_map>
-
+#include "../bumparena.hpp"
 #include "cps.hpp"
 #include "doms.hpp"
 
 namespace brmh::cps::schedule {
 
-using Schedule = std::unordered_map<Expr const*, Block const*>;
+// The exprs scheduled into each block, in postorder so that iterating them does not depend on addresses:
+using Schedule = ArenaMap<Block const*, ArenaVector<Expr const*>>;
 
-Schedule schedule_late(Fn const* fn, doms::DomTree const& doms);
+// The schedule and the temporaries used to compute it live in `arena`:
+Schedule schedule_late(Fn const* fn, doms::DomTree const& doms, BumpArena& arena);
 
 }
 
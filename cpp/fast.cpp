@@ -1,6 +1,6 @@
 #include "fast.hpp"
 
-#include <cstring>
+#include <iterator>
 
 namespace brmh::fast {
 
@@ -56,7 +56,8 @@ char const*  MulWI64::opname() const { return "mulWI64"; }
 
 // ## Id
 
-Id::Id(Span span, type::Type* type, Name name_) : Expr(span, type), name(name_) {}
+Id::Id(Span span, type::Type* type, Name name_, std::span<type::Type* const> type_args_)
+    : Expr(span, type), name(name_), type_args(type_args_) {}
 
 void Id::print(Names const& names, std::ostream& dest) const { name.print(names, dest); }
 
@@ -66,10 +67,9 @@ Const::Const(Span span, type::Type* type) : Expr(span, type) {}
 
 // ### I64
 
-I64::I64(Span span, type::Type* type, const char* digits, std::size_t size)
-    : Const(span, type), digits(strndup(digits, size)) {}
+I64::I64(Span span, type::Type* type, std::int64_t v) : Const(span, type), value(v) {}
 
-void I64::print(Names const&, std::ostream& dest) const { dest << digits; }
+void I64::print(Names const&, std::ostream& dest) const { dest << value; }
 
 // # Def
 
@@ -78,7 +78,7 @@ Def::Def(Span span_) : span(span_) {}
 // ## FunDef
 
 FunDef::FunDef(Span span, Name name_, std::vector<Pat*>&& params_, type::Type* codomain_, Expr* body_)
-    : Def(span), name(name_), params(params_), codomain(codomain_), body(body_) {}
+    : Def(span), name(name_), params(params_), codomain(codomain_), body(body_), type_params() {}
 
 std::vector<type::Type*> fast::FunDef::domain() const {
     std::vector<type::Type*> res;
@@ -120,40 +120,64 @@ void FunDef::print(Names const& names, std::ostream& dest) const {
 // # Program
 
 If* Program::if_(Span span, type::Type *type, Expr *cond, Expr *conseq, Expr *alt) {
-    return new(arena_.alloc<If>()) If(span, type, cond, conseq, alt);
+    return typed(new(arena_.alloc<If>()) If(span, type, cond, conseq, alt));
 }
 
 AddWI64* Program::add_w_i64(Span span, type::Type* type, std::array<Expr*, 2> args){
-    return new(arena_.alloc<AddWI64>()) AddWI64(span, type, args);
+    return typed(new(arena_.alloc<AddWI64>()) AddWI64(span, type, args));
 }
 
 SubWI64* Program::sub_w_i64(Span span, type::Type* type, std::array<Expr*, 2> args){
-    return new(arena_.alloc<SubWI64>()) SubWI64(span, type, args);
+    return typed(new(arena_.alloc<SubWI64>()) SubWI64(span, type, args));
 }
 
 MulWI64* Program::mul_w_i64(Span span, type::Type* type, std::array<Expr*, 2> args){
-    return new(arena_.alloc<MulWI64>()) MulWI64(span, type, args);
+    return typed(new(arena_.alloc<MulWI64>()) MulWI64(span, type, args));
 }
 
-Id* Program::id(Span span, type::Type* type, Name name) {
-    return new(arena_.alloc<Id>()) Id(span, type, name); }
+Id* Program::id(Span span, type::Type* type, Name name, std::span<type::Type* const> type_args) {
+    return typed(new(arena_.alloc<Id>()) Id(span, type, name, type_args));
+}
 
 Bool *Program::const_bool(Span span, type::Type *type, bool value) {
-    return new(arena_.alloc<Bool>()) Bool(span, type, value);
+    return typed(new(arena_.alloc<Bool>()) Bool(span, type, value));
 }
 
-I64* Program::const_i64(Span span, type::Type* type, const char* chars, std::size_t size) {
-    return new(arena_.alloc<I64>()) I64(span, type, chars, size);
+I64* Program::const_i64(Span span, type::Type* type, std::int64_t value) {
+    return typed(new(arena_.alloc<I64>()) I64(span, type, value));
 }
 
 FunDef* Program::fun_def(Span span, Name name, std::vector<Pat*>&& params, type::Type* codomain, Expr* body) {
-    return new(arena_.alloc<FunDef>()) FunDef(span, name, std::move(params), codomain, body);
+    FunDef* const fun_def = new(arena_.alloc<FunDef>()) FunDef(span, name, std::move(params), codomain, body);
+    if (!codomain->is_interned()) { unzonked_.push_back(&fun_def->codomain); }
+    return fun_def;
 }
 
 void Program::push_toplevel(Def* def) {
     defs.push_back(def);
 }
 
+void Program::zonk(type::Types& types) {
+    for (type::Type** const type : unzonked_) {
+        *type = (*type)->zonk(types);
+    }
+    unzonked_.clear();
+}
+
+void Program::absorb(Program&& other) {
+    absorbed_.push_back(std::move(other.arena_));
+    std::move(other.absorbed_.begin(), other.absorbed_.end(), std::back_inserter(absorbed_));
+    other.absorbed_.clear();
+}
+
+BumpArena::Stats Program::arena_stats() const {
+    BumpArena::Stats stats = arena_.stats();
+    for (BumpArena const& arena : absorbed_) {
+        stats += arena.stats();
+    }
+    return stats;
+}
+
 void Program::print(Names const& names, std::ostream& dest) const {
     for (const auto def : defs) {
         def->print(names, dest);
@@ -1,7 +1,9 @@
 #ifndef BRMH_FAST_HPP
 #define BRMH_FAST_HPP
 
+#include <cstdint>
 #include <optional>
+#include <unordered_map>
 
 #include "bumparena.hpp"
 #include "type.hpp"
@@ -11,8 +13,12 @@ namespace brmh::fast {
 
 struct Call;
 struct Stmt;
+struct FunDef;
 struct Program;
 
+// Polymorphic functions by name, for building their instances in `to_cps`:
+using Generics = std::unordered_map<Name, FunDef const*, Name::Hash>;
+
 // # to_cps utils
 
 struct ToCpsCont {
@@ -196,11 +202,13 @@ struct Id : public Expr {
     virtual cps::Expr* to_cps(cps::Builder& builder, cps::Fn* fn, ToCpsCont const& k, std::optional<Name> name) const override;
 
     Name name;
+    // What the `type_params` of a polymorphic function were instantiated with here:
+    std::span<type::Type* const> type_args;
 
 private:
     friend struct Program;
 
-    Id(Span span, type::Type* type, Name name);
+    Id(Span span, type::Type* type, Name name, std::span<type::Type* const> type_args);
 };
 
 struct Const : public Expr {
@@ -228,12 +236,12 @@ struct I64 : public Const {
 
     virtual cps::Expr* to_cps(cps::Builder& builder, cps::Fn* fn, ToCpsCont const& k, std::optional<Name> name) const override;
 
-    const char* digits;
+    std::int64_t value;
 
 private:
     friend struct Program;
 
-    I64(Span span, type::Type* type, const char* digits, std::size_t size);
+    I64(Span span, type::Type* type, std::int64_t value);
 };
 
 // # Patterns
@@ -309,7 +317,7 @@ public:
 struct Def {
     virtual void print(Names const& names, std::ostream& dest) const = 0;
 
-    virtual void cps_declare(cps::Builder& builder) const = 0;
+    virtual void cps_declare(cps::Builder& builder, Generics& generics) const = 0;
     virtual void to_cps(cps::Builder& builder) const = 0;
 
     Span span;
@@ -323,17 +331,23 @@ struct FunDef : public Def {
 
     virtual void print(Names const& names, std::ostream& dest) const override;
 
-    virtual void cps_declare(cps::Builder& builder) const override;
+    virtual void cps_declare(cps::Builder& builder, Generics& generics) const override;
     virtual void to_cps(cps::Builder& builder) const override;
+    void to_cps(cps::Builder& builder, cps::Builder::Instance const& instance) const;
 
     Name name;
     std::vector<Pat*> params;
     type::Type* codomain;
     Expr* body;
+    // The generic `Uv`:s of a polymorphic function (in `Type::generalize` order), which makes it only get code for its
+    // instances:
+    std::span<type::Uv* const> type_params;
 
 private:
     friend struct Program;
 
+    void body_to_cps(cps::Builder& builder, cps::Fn* fn) const;
+
     FunDef(Span span, Name name, std::vector<Pat*>&& params, type::Type* codomain, Expr* body);
 };
 
@@ -349,17 +363,28 @@ struct Program {
     }
 
     Expr* block(Span span, type::Type* type, std::span<Stmt*> stmts, Expr* body) {
-        return new (arena_.alloc<Block>()) Block(span, type, std::move(stmts), body);
+        return typed(new (arena_.alloc<Block>()) Block(span, type, std::move(stmts), body));
     }
 
     If* if_(Span span, type::Type* type, Expr* cond, Expr* conseq, Expr* alt);
 
+    std::span<type::Type* const> type_args(std::span<type::Type* const> args) {
+        if (args.empty()) { return {}; }
+
+        type::Type** const type_args = static_cast<type::Type**>(arena_.alloc_array<type::Type*>(args.size()));
+        std::copy(args.begin(), args.end(), type_args);
+        for (std::size_t i = 0; i < args.size(); ++i) {
+            if (!type_args[i]->is_interned()) { unzonked_.push_back(&type_args[i]); }
+        }
+        return {type_args, args.size()};
+    }
+
     std::span<Expr*> args(std::size_t arity) {
         return std::span<Expr*>(static_cast<Expr**>(arena_.alloc_array<Expr*>(arity)), arity);
     }
 
     Call* call(Span span, type::Type* type, Expr* callee, std::span<Expr*> args) {
-        return new (arena_.alloc<Call>()) Call(span, type, callee, args);
+        return typed(new (arena_.alloc<Call>()) Call(span, type, callee, args));
     }
 
     AddWI64* add_w_i64(Span span, type::Type* type, std::array<Expr*, 2> args);
@@ -367,29 +392,52 @@ struct Program {
     MulWI64* mul_w_i64(Span span, type::Type* type, std::array<Expr*, 2> args);
 
     EqI64* eq_i64(Span span, type::Type* type, std::array<Expr*, 2> args) {
-        return new(arena_.alloc<EqI64>()) EqI64(span, type, args);
+        return typed(new(arena_.alloc<EqI64>()) EqI64(span, type, args));
     }
 
-    Id* id(Span span, type::Type* type, Name name);
+    Id* id(Span span, type::Type* type, Name name, std::span<type::Type* const> type_args);
     Bool* const_bool(Span span, type::Type* type, bool value);
-    I64* const_i64(Span span, type::Type* type, const char* chars, std::size_t size);
+    I64* const_i64(Span span, type::Type* type, std::int64_t value);
 
     IdPat* id_pat(Span span, type::Type* type, Name name) {
-        return new (arena_.alloc<IdPat>()) IdPat(span, type, name);
+        return typed(new (arena_.alloc<IdPat>()) IdPat(span, type, name));
     }
 
     FunDef* fun_def(Span span, Name name, std::vector<Pat*>&& params, type::Type* codomain, Expr* body);
 
     void push_toplevel(Def* def);
 
+    // Replaces the types of the nodes made since the last call with their `type::Type::zonk`, once inference has
+    // settled them. Walks a log of the type fields instead of the tree, so nesting depth does not matter:
+    void zonk(type::Types& types);
+
+    // Takes over the nodes of `other` (whose `defs` the caller pushes here as it sees fit), for gathering the output of
+    // the typer threads:
+    void absorb(Program&& other);
+
+    // Unlike lexing, parsing and checking, printing and `to_cps` still recurse on the expression tree, so input that
+    // `check` accepts can still overflow the stack here. With 8 MiB of stack, 100k nested calls get through printing
+    // but not `to_cps` at -O2. Unoptimized, even printing fails somewhere between 20k and 40k.
     void print(Names const& names, std::ostream& dest) const;
 
     cps::Program to_cps(Names& names, type::Types& types) const;
 
+    // Of all the arenas, including absorbed ones:
+    BumpArena::Stats arena_stats() const;
+
     std::vector<Def*> defs;
 
 private:
+    // Logs where `node` keeps its type, for `zonk`. Interned types are canonical already (and stay so):
+    template<typename Node>
+    Node* typed(Node* node) {
+        if (!node->type->is_interned()) { unzonked_.push_back(&node->type); }
+        return node;
+    }
+
     BumpArena arena_;
+    std::vector<BumpArena> absorbed_;
+    std::vector<type::Type**> unzonked_; // Type fields of the nodes made since the last `zonk`
 };
 
 } // namespace brmh
@@ -0,0 +1,73 @@
+#ifndef BRMH_HASH_HPP
+#define BRMH_HASH_HPP
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace brmh {
+
+// String hash that consumes 8 bytes at a time (as little-endian words, zero-padded at the end) so that the lexer
+// can compute it chunk by chunk while it is still finding the end of an identifier.
+
+static constexpr std::uint64_t HASH_SEED = 0xcbf29ce484222325;
+
+constexpr std::uint64_t hash_word(std::uint64_t hash, std::uint64_t word) {
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15;
+    return hash ^ (hash >> 32);
+}
+
+constexpr std::uint64_t hash_finish(std::uint64_t hash, std::size_t size) {
+    // MurmurHash3 fmix64:
+    hash ^= size;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccd;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// Load `size` (<= 8) bytes as a zero-padded little-endian word:
+inline std::uint64_t load_hash_word(const char* chars, std::size_t size) {
+    std::uint64_t word = 0;
+    std::memcpy(&word, chars, size);
+    if constexpr (std::endian::native == std::endian::big) {
+        word = __builtin_bswap64(word);
+    }
+    return word;
+}
+
+// Like `load_hash_word` but always reads 8 bytes, so `chars` must be followed by some padding (as `Src` provides):
+inline std::uint64_t load_padded_hash_word(const char* chars, std::size_t size) {
+    std::uint64_t word;
+    std::memcpy(&word, chars, sizeof word);
+    if constexpr (std::endian::native == std::endian::big) {
+        word = __builtin_bswap64(word);
+    }
+    return size < 8 ? word & ((std::uint64_t(1) << (8 * size)) - 1) : word;
+}
+
+constexpr std::uint64_t hash_chars(std::string_view chars) {
+    std::uint64_t hash = HASH_SEED;
+
+    for (std::size_t i = 0; i < chars.size(); i += 8) {
+        std::uint64_t word = 0;
+        if (std::is_constant_evaluated()) {
+            for (std::size_t j = 0; j < 8 && i + j < chars.size(); ++j) {
+                word |= std::uint64_t(static_cast<unsigned char>(chars[i + j])) << (8 * j);
+            }
+        } else {
+            word = load_hash_word(chars.data() + i, std::min<std::size_t>(8, chars.size() - i));
+        }
+        hash = hash_word(hash, word);
+    }
+
+    return hash_finish(hash, chars.size());
+}
+
+} // namespace brmh
+
+#endif // BRMH_HASH_HPP
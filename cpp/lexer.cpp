@@ -2,6 +2,9 @@
 
 #include <cstring>
 
+#include "scan.hpp"
+#include "perfecthash.hpp"
+
 namespace brmh {
 
 // # Lexer::Error
@@ -12,7 +15,18 @@ const char* Lexer::Error::what() const noexcept { return "LexError"; }
 
 // # Lexer
 
-void Lexer::Token::print(std::ostream& out) const {
+static constexpr PerfectHashMap<Lexer::Token::Type, 8> KEYWORDS({{
+    {"val", Lexer::Token::Type::VAL},
+    {"fun", Lexer::Token::Type::FUN},
+    {"if", Lexer::Token::Type::IF},
+    {"else", Lexer::Token::Type::ELSE},
+    {"True", Lexer::Token::Type::TRUE},
+    {"False", Lexer::Token::Type::FALSE},
+    {"bool", Lexer::Token::Type::BOOL},
+    {"i64", Lexer::Token::Type::I64_T}
+}});
+
+void Lexer::Token::print(SourceMap const& sources, std::ostream& out) const {
     out << "<Token ";
     {
         const char* c = chars;
@@ -21,135 +35,126 @@ void Lexer::Token::print(std::ostream& out) const {
         }
     }
     out << " @ ";
-    span.print(out);
+    span.print(sources, out);
     out << ">";
 }
 
-Lexer::Lexer(const Src& src) : chars_(src.source_code()), pos_(Pos(src.filename(), 1, 1)) {}
+TokenBuffer Lexer::tokenize(SourceMap const& sources, FileId file, Names& names) {
+    Src const& src = sources.src(file);
+    TokenBuffer tokens {.file = file, .chars = src.source_code(), .src_size = static_cast<std::uint32_t>(src.size()),
+                        .types = {}, .offsets = {}, .sizes = {}, .payloads = {}};
+    std::size_t const capacity_guess = src.size() / 3;
+    tokens.types.reserve(capacity_guess);
+    tokens.offsets.reserve(capacity_guess);
+    tokens.sizes.reserve(capacity_guess);
+    tokens.payloads.reserve(capacity_guess);
+
+    Lexer lexer(sources, file, names, tokens);
+    while (lexer.lex()) {}
+
+    return tokens;
+}
 
-Pos Lexer::pos() const { return pos_; }
+Lexer::Lexer(SourceMap const& sources, FileId file, Names& names, TokenBuffer& tokens)
+    : names_(names), tokens_(tokens), file_(file),
+      start_(sources.src(file).source_code()), end_(start_ + sources.src(file).size()), chars_(start_) {}
+
+Pos Lexer::pos() const { return Pos {file_, static_cast<std::uint32_t>(chars_ - start_)}; }
+
+// Append the token of type `type` and length `size` at `chars_` to `tokens_` and consume it:
+void Lexer::push(Lexer::Token::Type type, uintptr_t size, Lexer::Token::Payload payload) {
+    tokens_.types.push_back(type);
+    tokens_.offsets.push_back(static_cast<std::uint32_t>(chars_ - start_));
+    tokens_.sizes.push_back(static_cast<std::uint32_t>(size));
+    tokens_.payloads.push_back(payload);
+    chars_ += size;
+}
 
-optional<Lexer::Token> Lexer::peek() {
+// Lex the token at `chars_`, after skipping any whitespace. Returns false at the end of the source.
+bool Lexer::lex() {
     while (true) {
         switch (*chars_) {
-        case '\0': return optional<Lexer::Token>();
+        case '\0':
+            if (chars_ < end_) { throw Error(pos()); } // NUL within the source
+            return false;
 
-        case ',': return optional(Lexer::Token {Lexer::Token::Type::COMMA, chars_, 1, {pos_, pos_.next(*chars_)}});
-        case ';': return optional(Lexer::Token {Lexer::Token::Type::SEMICOLON, chars_, 1, {pos_, pos_.next(*chars_)}});
+        case ',': push(Lexer::Token::Type::COMMA, 1); return true;
+        case ';': push(Lexer::Token::Type::SEMICOLON, 1); return true;
 
-        case '.': return optional(Lexer::Token {Lexer::Token::Type::DOT, chars_, 1, {pos_, pos_.next(*chars_)}});
+        case '.': push(Lexer::Token::Type::DOT, 1); return true;
 
-        case '=': return optional(Lexer::Token {Lexer::Token::Type::EQUALS, chars_, 1, {pos_, pos_.next(*chars_)}});
-        case ':': return optional(Lexer::Token {Lexer::Token::Type::COLON, chars_, 1, {pos_, pos_.next(*chars_)}});
+        case '=': push(Lexer::Token::Type::EQUALS, 1); return true;
+        case ':': push(Lexer::Token::Type::COLON, 1); return true;
 
-        case '(': return optional(Lexer::Token {Lexer::Token::Type::LPAREN, chars_, 1, {pos_, pos_.next(*chars_)}});
-        case ')': return optional(Lexer::Token {Lexer::Token::Type::RPAREN, chars_, 1, {pos_, pos_.next(*chars_)}});
-        case '[': return optional(Lexer::Token {Lexer::Token::Type::LBRACKET, chars_, 1, {pos_, pos_.next(*chars_)}});
-        case ']': return optional(Lexer::Token {Lexer::Token::Type::RBRACKET, chars_, 1, {pos_, pos_.next(*chars_)}});
-        case '{': return optional(Lexer::Token {Lexer::Token::Type::LBRACE, chars_, 1, {pos_, pos_.next(*chars_)}});
-        case '}': return optional(Lexer::Token {Lexer::Token::Type::RBRACE, chars_, 1, {pos_, pos_.next(*chars_)}});
+        case '(': push(Lexer::Token::Type::LPAREN, 1); return true;
+        case ')': push(Lexer::Token::Type::RPAREN, 1); return true;
+        case '[': push(Lexer::Token::Type::LBRACKET, 1); return true;
+        case ']': push(Lexer::Token::Type::RBRACKET, 1); return true;
+        case '{': push(Lexer::Token::Type::LBRACE, 1); return true;
+        case '}': push(Lexer::Token::Type::RBRACE, 1); return true;
 
         default:
             if (*chars_ == '_' && chars_[1] == '_') {
-                return lex_primop();
-            } else if (isspace(*chars_)) {
-                pos_ = pos_.next(*chars_);
-                ++chars_;
+                lex_primop();
+                return true;
+            } else if (scan::is_space(*chars_)) {
+                chars_ = scan::spaces(chars_);
                 continue;
-            } else if (isalpha(*chars_)) {
-                return lex_id();
-            } else if (isdigit(*chars_)) {
-                return lex_int();
+            } else if (scan::is_alpha(*chars_)) {
+                lex_id();
+                return true;
+            } else if (scan::is_digit(*chars_)) {
+                lex_int();
+                return true;
             } else {
-                return optional<Lexer::Token>();
+                throw Error(pos());
             }
         }
     }
 }
 
-Lexer::Token Lexer::peek_some() {
-    const optional<Token> tok = peek();
-    if (tok) {
-        return tok.value();
-    } else {
-        throw Error(pos());
-    }
+void Lexer::lex_primop() {
+    push(Lexer::Token::Type::PRIMOP, 2 /* "__" */ + scan::alnums(chars_ + 2));
 }
 
-optional<Lexer::Token> Lexer::lex_primop() {
-    Pos const start = pos_;
-    Pos end = start;
-
-    uintptr_t size = 2; // "__"
-    for (const char* c = chars_ + size; isalnum(*c); ++c) {
-        ++size;
-        end = end.next(*c);
-    }
-
-    return optional(Lexer::Token {Lexer::Token::Type::PRIMOP, chars_, size, {start, end}});
-}
+// Keywords and identifiers share the hash computed while scanning:
+void Lexer::lex_id() {
+    std::uint64_t hash;
+    uintptr_t const size = scan::hashed_alnums(chars_, hash);
 
-optional<Lexer::Token> Lexer::lex_id() {
-    Pos const start = pos_;
-    Pos end = start;
-
-    uintptr_t size = 0;
-    for (const char* c = chars_; isalnum(*c); ++c) {
-        ++size;
-        end = end.next(*c);
+    if (optional<Lexer::Token::Type> const keyword = KEYWORDS.find(chars_, size, hash)) {
+        push(*keyword, size);
+    } else {
+        push(Lexer::Token::Type::ID, size, Lexer::Token::Payload(names_.sourced(chars_, size, hash)));
     }
-
-    const Lexer::Token::Type type = strncmp(chars_, "val", size) == 0
-            ? Lexer::Token::Type::VAL
-            : strncmp(chars_, "fun", size) == 0
-              ? Lexer::Token::Type::FUN
-              : strncmp(chars_, "if", size) == 0
-                ? Lexer::Token::Type::IF
-                : strncmp(chars_, "else", size) == 0
-                  ? Lexer::Token::Type::ELSE
-                  : strncmp(chars_, "True", size) == 0
-                    ? Lexer::Token::Type::TRUE
-                    : strncmp(chars_, "False", size) == 0
-                      ? Lexer::Token::Type::FALSE
-                      : strncmp(chars_, "bool", size) == 0
-                        ? Lexer::Token::Type::BOOL
-                        : strncmp(chars_, "i64", size) == 0
-                          ? Lexer::Token::Type::I64_T
-                          : Lexer::Token::Type::ID;
-    return optional(Lexer::Token {type, chars_, size, {start, end}});
 }
 
-optional<Lexer::Token> Lexer::lex_int() {
-    Pos const start = pos_;
-    Pos end = start;
+void Lexer::lex_int() {
+    uintptr_t const size = scan::digits(chars_);
 
-    uintptr_t size = 0;
-    for (const char* c = chars_; isdigit(*c); ++c) {
-        ++size;
-        end = end.next(*c);
+    // 18 decimal digits always fit in an i64 so only longer literals need overflow checks:
+    std::int64_t value = 0;
+    if (size <= 18) {
+        for (uintptr_t i = 0; i < size; ++i) {
+            value = value * 10 + (chars_[i] - '0');
+        }
+    } else {
+        for (uintptr_t i = 0; i < size; ++i) {
+            if (__builtin_mul_overflow(value, 10, &value) || __builtin_add_overflow(value, chars_[i] - '0', &value)) {
+                throw IntOverflowError(pos());
+            }
+        }
     }
 
-    return optional(Lexer::Token {Lexer::Token::Type::INT, chars_, size, {start, end}});
-}
-
-void Lexer::next() {
-    const auto token = peek();
-
-    if (token) {
-        chars_ += token->size;
-        pos_ = token->span.end;
-    }
+    push(Lexer::Token::Type::INT, size, Lexer::Token::Payload(value));
 }
 
-void Lexer::match(Token::Type type) {
-    const auto opt_tok = peek();
+// # TokenBuffer
 
-    if (opt_tok) {
-        const auto tok = opt_tok.value();
-        if (tok.typ == type) {
-            chars_ += tok.size;
-            pos_ = tok.span.end;
-        }
+void TokenBuffer::print(SourceMap const& sources, std::ostream& out) const {
+    for (std::size_t i = 0; i < size(); ++i) {
+        at(i).print(sources, out);
+        out << std::endl;
     }
 }
 
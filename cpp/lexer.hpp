@@ -4,18 +4,22 @@
 #include <cstdint>
 #include <optional>
 #include <ostream>
+#include <vector>
 
-#include "src.hpp"
+#include "sourcemap.hpp"
 #include "span.hpp"
+#include "name.hpp"
 #include "error.hpp"
 
 namespace brmh {
 
 using std::optional;
 
+struct TokenBuffer;
+
 struct Lexer {
     struct Token {
-        enum struct Type {
+        enum struct Type : std::uint8_t {
             LPAREN, RPAREN, LBRACKET, RBRACKET, LBRACE, RBRACE,
             COMMA, SEMICOLON,
             DOT,
@@ -24,12 +28,24 @@ struct Lexer {
             ID, PRIMOP, IF, ELSE, VAL, FUN, TRUE, FALSE, BOOL, I64_T
         };
 
-        void print(std::ostream& out) const;
+        // Lexer-computed value of the token, discriminated by `Type`:
+        union Payload {
+            char none;
+            Name name; // ID
+            std::int64_t i64; // INT
+
+            Payload() : none() {}
+            explicit Payload(Name name_) : name(name_) {}
+            explicit Payload(std::int64_t i64_) : i64(i64_) {}
+        };
+
+        void print(SourceMap const& sources, std::ostream& out) const;
 
         Type typ;
         const char* chars;
         uintptr_t size;
         Span span;
+        Payload payload;
     };
 
     class Error : public BrmhError {
@@ -41,22 +57,58 @@ struct Lexer {
         Pos pos;
     };
 
-    explicit Lexer(const Src& src);
-    Lexer() = delete;
+    // Integer literal that does not fit in an i64:
+    class IntOverflowError : public Error {
+    public:
+        explicit IntOverflowError(Pos pos) : Error(pos) {}
 
-    Pos pos() const;
-    optional<Token> peek();
-    Token peek_some();
-    void next();
-    void match(Token::Type type);
+        virtual const char* what() const noexcept override { return "IntOverflowError"; }
+    };
+
+    // Lex the whole file in one pass. The source must be NUL-padded as `Src` guarantees.
+    // Identifiers get interned into `names` along the way.
+    static TokenBuffer tokenize(SourceMap const& sources, FileId file, Names& names);
 
 private:
-    optional<Token> lex_primop();
-    optional<Token> lex_id();
-    optional<Token> lex_int();
+    Lexer(SourceMap const& sources, FileId file, Names& names, TokenBuffer& tokens);
 
+    Pos pos() const;
+    void push(Token::Type type, uintptr_t size, Token::Payload payload = Token::Payload());
+    bool lex();
+    void lex_primop();
+    void lex_id();
+    void lex_int();
+
+    Names& names_;
+    TokenBuffer& tokens_;
+    FileId file_;
+    char const* start_;
+    char const* end_;
     char const* chars_;
-    Pos pos_;
+};
+
+// Struct-of-arrays buffer of all the tokens of a file.
+struct TokenBuffer {
+    FileId file;
+    const char* chars;
+    std::uint32_t src_size;
+    std::vector<Lexer::Token::Type> types;
+    std::vector<std::uint32_t> offsets;
+    std::vector<std::uint32_t> sizes;
+    std::vector<Lexer::Token::Payload> payloads;
+
+    std::size_t size() const { return types.size(); }
+
+    Lexer::Token at(std::size_t index) const {
+        return Lexer::Token {types[index], chars + offsets[index], sizes[index],
+                             Span(Pos {file, offsets[index]}, Pos {file, offsets[index] + sizes[index]}),
+                             payloads[index]};
+    }
+
+    // Position just past the last token:
+    Pos end_pos() const { return Pos {file, src_size}; }
+
+    void print(SourceMap const& sources, std::ostream& out) const;
 };
 
 } // namespace brmh
@@ -1,6 +1,10 @@
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <optional>
+#include <cstring>
+#include <cctype>
+#include <cstdlib>
 
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/Support/Host.h"
@@ -13,9 +17,11 @@
 
 #include "util.cpp"
 #include "bumparena.cpp"
+#include "memreport.cpp"
 #include "filename.cpp"
 #include "pos.cpp"
 #include "src.cpp"
+#include "sourcemap.cpp"
 #include "span.cpp"
 #include "name.cpp"
 #include "error.cpp"
@@ -24,6 +30,7 @@
 
 #include "ast.cpp"
 
+#include "scan.cpp"
 #include "lexer.cpp"
 #include "parser.cpp"
 
@@ -39,11 +46,16 @@
 
 #include "to_llvm.cpp"
 
+#include "parallel.hpp"
+
 namespace brmh {
 
 struct CLIArgs {
     std::string outfile;
     std::vector<std::string> infiles;
+    std::size_t jobs; // Worker threads for the front end
+    std::optional<MemReport::Format> mem_report;
+    std::optional<std::string> mem_report_file; // From `--mem-report=json:PATH`; JSON goes to stderr otherwise
 
     class Error : public std::exception {
         virtual const char* what() const noexcept override { return "CLIArgs::Parser::Error"; }
@@ -52,9 +64,12 @@ struct CLIArgs {
     static CLIArgs parse(std::size_t argc, char const* const* argv) {
         std::optional<std::string> outfile;
         std::vector<std::string> infiles;
+        std::optional<std::size_t> jobs;
+        std::optional<MemReport::Format> mem_report;
+        std::optional<std::string> mem_report_file;
 
         for (std::size_t i = 1 /* skip program name */; i < argc; ++i) {
-            if (argv[i][0] == '-') {
+            if (argv[i][0] == '-' && argv[i][1] != '\0') { // Lone "-" is stdin
                 switch (argv[i][1]) {
                 case 'o':
                     if (argv[i][2] == '\0') {
@@ -72,6 +87,36 @@ struct CLIArgs {
                         throw Error(); // Too long option
                     }
                     break;
+                case 'j': {
+                    const char* count = nullptr;
+                    if (argv[i][2] != '\0') {
+                        count = argv[i] + 2; // "-jN"
+                    } else if (++i < argc) {
+                        count = argv[i]; // "-j N"
+                    } else {
+                        throw Error(); // Missing job count
+                    }
+
+                    char* end = nullptr;
+                    unsigned long const n = std::strtoul(count, &end, 10);
+                    if (!std::isdigit(static_cast<unsigned char>(*count)) || *end != '\0' || n == 0) {
+                        throw Error(); // Invalid job count
+                    }
+                    jobs = n;
+                    break;
+                }
+                case '-':
+                    if (std::strcmp(argv[i], "--mem-report") == 0) {
+                        mem_report = MemReport::Format::TEXT;
+                    } else if (std::strcmp(argv[i], "--mem-report=json") == 0) {
+                        mem_report = MemReport::Format::JSON;
+                    } else if (std::strncmp(argv[i], "--mem-report=json:", 18) == 0 && argv[i][18] != '\0') {
+                        mem_report = MemReport::Format::JSON;
+                        mem_report_file = argv[i] + 18;
+                    } else {
+                        throw Error(); // Unrecognized long option
+                    }
+                    break;
                 default: throw Error(); // Unrecognized option
                 }
             } else {
@@ -79,13 +124,15 @@ struct CLIArgs {
             }
         }
 
-        return {.outfile = std::move(outfile.value_or("output.o")), .infiles = std::move(infiles)};
+        return {.outfile = std::move(outfile.value_or("output.o")), .infiles = std::move(infiles),
+                .jobs = jobs.value_or(hardware_threads()), .mem_report = mem_report,
+                .mem_report_file = std::move(mem_report_file)};
     }
 };
 
 } // namespace brmh
 
-// TODO: Memory management (using bumpalo arenas and taking advantage of "IR going through passes" nature)
+// TODO: `fast::FunDef::params` is a `std::vector` in an arena node, so its buffer leaks when the F-AST is freed.
 
 int main (int argc, char const* const* argv) {
     brmh::CLIArgs const args = brmh::CLIArgs::parse(argc, argv);
@@ -93,44 +140,63 @@ int main (int argc, char const* const* argv) {
     if (args.infiles.size() == 0) {
         std::cerr << "No input files" << std::endl;
         return EXIT_FAILURE;
-    } else if (args.infiles.size() > 1) {
-        std::cerr << "TODO: multiple input files" << std::endl;
-        return EXIT_FAILURE;
     } else {
-        brmh::Src const src = brmh::Src::file(args.infiles[0].c_str());
+        brmh::SourceMap sources;
 
         try {
-            std::cout << "Tokens\n======" << std::endl << std::endl;
+            std::vector<brmh::FileId> files;
+            files.reserve(args.infiles.size());
+            for (std::string const& infile : args.infiles) {
+                files.push_back(sources.add(brmh::Src::file(infile.c_str())));
+            }
 
-            brmh::Lexer tokens(src);
-            std::optional<brmh::Lexer::Token> tok;
-            do {
-                tok = tokens.peek();
-                tokens.next();
-                if (tok) {
-                    tok.value().print(std::cout);
-                    std::cout << std::endl;
-                }
-            } while (tok);
-
-            std::cout << std::endl << "AST\n===" << std::endl << std::endl;
+            brmh::MemReport mem_report;
 
             brmh::Names names;
             brmh::type::Types types(names);
 
-            brmh::Parser parser(brmh::Lexer(src), names, types);
-            brmh::ast::Program program = parser.program();
+            // Lex and parse the files in parallel:
+            std::vector<brmh::TokenBuffer> tokens(files.size());
+            std::vector<brmh::ast::Program> programs(files.size());
+            brmh::parallel_for(files.size(), args.jobs, [&](std::size_t i) {
+                tokens[i] = brmh::Lexer::tokenize(sources, files[i], names);
+                programs[i] = brmh::Parser(tokens[i], names, types).program();
+            });
+
+            std::cout << "Tokens\n======" << std::endl << std::endl;
+
+            for (brmh::TokenBuffer const& file_tokens : tokens) {
+                file_tokens.print(sources, std::cout);
+            }
+
+            std::cout << std::endl << "AST\n===" << std::endl << std::endl;
+
+            brmh::ast::Program program = brmh::ast::Program::merge(std::move(programs));
+            mem_report.phase("parse", "ast", program.arena_stats());
             program.print(names, std::cout);
 
             std::cout << "F-AST\n=====" << std::endl << std::endl;
 
-            brmh::fast::Program typed_program = program.check(names, types);
+            brmh::fast::Program typed_program = program.check(names, types, args.jobs);
+            mem_report.phase("check", "fast", typed_program.arena_stats());
+            mem_report.phase("check", "types", types.arena_stats());
+            // The F-AST does not point into the tokens or the AST, so they can be freed now:
+            tokens = {};
+            program = brmh::ast::Program();
             typed_program.print(names, std::cout);
 
             std::cout << "CPS\n===" << std::endl << std::endl;
 
             brmh::cps::Program cps_program = typed_program.to_cps(names, types);
-            cps_program.print(names, std::cout);
+            mem_report.phase("cps", "cps", cps_program.arena().stats());
+            brmh::BumpArena scratch; // For the CPS printer and `to_llvm`
+            cps_program.print(names, std::cout, scratch);
+
+            // The CPS does not point into the F-AST either. Free it and drop the names that only it (or the AST) used:
+            typed_program = brmh::fast::Program();
+            brmh::Names::Compaction name_compaction(names);
+            cps_program.keep_names(name_compaction);
+            mem_report.name_compaction("cps", name_compaction.finish());
 
             std::cout << "LLVM IR\n=======" << std::endl << std::endl;
 
@@ -159,7 +225,8 @@ int main (int argc, char const* const* argv) {
             llvm::Module llvm_module("bmrh program", llvm_ctx);
             llvm_module.setTargetTriple(target_triple);
             llvm_module.setDataLayout(target_machine->createDataLayout());
-            cps_program.to_llvm(names, llvm_ctx, llvm_module);
+            cps_program.to_llvm(names, llvm_ctx, llvm_module, scratch);
+            mem_report.phase("llvm", "scratch", scratch.stats());
 
             for (const auto& fn : llvm_module.functions()) {
                 fn.print(llvm::errs());
@@ -185,6 +252,25 @@ int main (int argc, char const* const* argv) {
 
             pass.run(llvm_module);
             outfile.flush();
+            mem_report.phase("emit");
+
+            // The text report is one more dump. JSON is for tools, so it goes to its own file or else as the last line of
+            // stderr, but never into the dumps on stdout:
+            if (args.mem_report == brmh::MemReport::Format::TEXT) {
+                std::cout << "Memory\n======" << std::endl << std::endl;
+                mem_report.print(std::cout, *args.mem_report);
+                std::cout << std::endl;
+            } else if (args.mem_report_file) {
+                std::ofstream report_file(*args.mem_report_file);
+                mem_report.print(report_file, *args.mem_report);
+                if (!report_file.flush()) {
+                    std::remove(obj_filename.c_str()); // TODO: Error handling
+                    std::cerr << "Could not write " << *args.mem_report_file << std::endl;
+                    return EXIT_FAILURE;
+                }
+            } else if (args.mem_report) {
+                mem_report.print(std::cerr, *args.mem_report);
+            }
 
             std::cout << ">>> Linking program binary..." << std::endl << std::endl;
 
@@ -200,17 +286,20 @@ int main (int argc, char const* const* argv) {
                 std::remove(obj_filename.c_str()); // TODO: Error handling
                 return EXIT_SUCCESS;
             }
+        } catch (const brmh::Src::Error& error) {
+            std::cerr << error.what() << ": " << error.filename.c_str() << ": " << strerror(error.errnum) << std::endl;
+            return EXIT_FAILURE;
         } catch (const brmh::Lexer::Error& error) {
             std::cerr << error.what() << " at ";
-            error.pos.print(std::cerr);
+            error.pos.print(sources, std::cerr);
             return EXIT_FAILURE;
         } catch (const brmh::Parser::Error& error) {
             std::cerr << error.what() << " at ";
-            error.pos.print(std::cerr);
+            error.pos.print(sources, std::cerr);
             return EXIT_FAILURE;
         } catch (const brmh::type::Error& error) {
             std::cerr << error.what() << " at ";
-            error.span.print(std::cerr);
+            error.span.print(sources, std::cerr);
             return EXIT_FAILURE;
         } catch (const brmh::BrmhError& error) {
             std::cerr << error.what() << std::endl;
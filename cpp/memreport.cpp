@@ -0,0 +1,103 @@
+#include "memreport.hpp"
+
+#include <iomanip>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+namespace brmh {
+
+std::size_t peak_rss() {
+#if defined(__APPLE__)
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? static_cast<std::size_t>(usage.ru_maxrss) : 0; // Bytes
+#elif defined(__unix__)
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? static_cast<std::size_t>(usage.ru_maxrss) * 1024 : 0; // KiB
+#else
+    return 0;
+#endif
+}
+
+void MemReport::phase(char const* name) {
+    phases_.push_back(Phase {.name = name, .arena_name = nullptr, .arena = {}, .peak_rss = peak_rss()});
+}
+
+void MemReport::phase(char const* name, char const* arena_name, BumpArena::Stats const& arena) {
+    phases_.push_back(Phase {.name = name, .arena_name = arena_name, .arena = arena, .peak_rss = peak_rss()});
+}
+
+void MemReport::name_compaction(char const* after_phase, Names::Compaction::Stats stats) {
+    name_compactions_.push_back(NameCompaction {.after_phase = after_phase, .stats = stats});
+}
+
+void MemReport::print(std::ostream& dest, Format format) const {
+    switch (format) {
+    case Format::TEXT: print_text(dest); break;
+    case Format::JSON: print_json(dest); break;
+    }
+}
+
+void MemReport::print_text(std::ostream& dest) const {
+    auto const kib = [] (std::size_t bytes) { return (bytes + 1023) / 1024; };
+
+    dest << std::left << std::setw(8) << "phase" << std::setw(9) << "arena" << std::right
+         << std::setw(14) << "requested KiB" << std::setw(13) << "padding KiB" << std::setw(8) << "chunks"
+         << std::setw(12) << "chunk KiB" << std::setw(15) << "peak RSS KiB" << '\n';
+
+    for (Phase const& phase : phases_) {
+        dest << std::left << std::setw(8) << phase.name << std::setw(9) << (phase.arena_name ? phase.arena_name : "-")
+             << std::right;
+        if (phase.arena_name) {
+            dest << std::setw(14) << kib(phase.arena.requested) << std::setw(13) << kib(phase.arena.alignment_waste)
+                 << std::setw(8) << phase.arena.chunks << std::setw(12) << kib(phase.arena.chunk_bytes);
+        } else {
+            dest << std::setw(14) << '-' << std::setw(13) << '-' << std::setw(8) << '-' << std::setw(12) << '-';
+        }
+        dest << std::setw(15) << kib(phase.peak_rss) << '\n';
+    }
+
+    for (NameCompaction const& compaction : name_compactions_) {
+        Names::Compaction::Stats const& stats = compaction.stats;
+        dest << "\nname ids after " << compaction.after_phase << ": " << stats.issued << " issued -> " << stats.live
+             << " live (" << stats.issued - stats.live << " reclaimed), " << stats.block_slack
+             << " unissued in fresh id blocks\n";
+    }
+}
+
+// Names are fixed identifiers, so they need no escaping:
+void MemReport::print_json(std::ostream& dest) const {
+    dest << "{\"phases\": [";
+
+    for (std::size_t i = 0; i < phases_.size(); ++i) {
+        Phase const& phase = phases_[i];
+
+        if (i > 0) { dest << ", "; }
+        dest << "{\"name\": \"" << phase.name << "\", \"arena\": ";
+        if (phase.arena_name) {
+            dest << "{\"name\": \"" << phase.arena_name << "\", \"requested\": " << phase.arena.requested
+                 << ", \"alignment_waste\": " << phase.arena.alignment_waste << ", \"chunks\": " << phase.arena.chunks
+                 << ", \"chunk_bytes\": " << phase.arena.chunk_bytes << '}';
+        } else {
+            dest << "null";
+        }
+        dest << ", \"peak_rss\": " << phase.peak_rss << '}';
+    }
+
+    dest << "], \"name_compactions\": [";
+
+    for (std::size_t i = 0; i < name_compactions_.size(); ++i) {
+        NameCompaction const& compaction = name_compactions_[i];
+
+        if (i > 0) { dest << ", "; }
+        Names::Compaction::Stats const& stats = compaction.stats;
+        dest << "{\"after\": \"" << compaction.after_phase << "\", \"issued\": " << stats.issued << ", \"live\": "
+             << stats.live << ", \"reclaimed\": " << stats.issued - stats.live << ", \"block_slack\": "
+             << stats.block_slack << '}';
+    }
+
+    dest << "]}\n";
+}
+
+} // namespace brmh
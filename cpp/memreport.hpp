@@ -0,0 +1,49 @@
+#ifndef BRMH_MEMREPORT_HPP
+#define BRMH_MEMREPORT_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+#include "bumparena.hpp"
+#include "name.hpp"
+
+namespace brmh {
+
+// Peak resident set size of the process so far, in bytes; 0 if the platform cannot tell:
+std::size_t peak_rss();
+
+// Memory use of the compiler phases, for `--mem-report`. Not everything lives in arenas (e.g. the token buffers), so the
+// peak RSS after each phase is recorded along with the stats of the arena (if any) that the phase allocated in.
+struct MemReport {
+    enum struct Format { TEXT, JSON };
+
+    struct Phase {
+        char const* name;
+        char const* arena_name; // nullptr if the phase has no arena of its own
+        BumpArena::Stats arena;
+        std::size_t peak_rss;
+    };
+
+    void phase(char const* name);
+    void phase(char const* name, char const* arena_name, BumpArena::Stats const& arena);
+    void name_compaction(char const* after_phase, Names::Compaction::Stats stats);
+
+    void print(std::ostream& dest, Format format) const;
+
+private:
+    void print_text(std::ostream& dest) const;
+    void print_json(std::ostream& dest) const;
+
+    struct NameCompaction {
+        char const* after_phase;
+        Names::Compaction::Stats stats;
+    };
+
+    std::vector<Phase> phases_;
+    std::vector<NameCompaction> name_compactions_;
+};
+
+} // namespace brmh
+
+#endif // BRMH_MEMREPORT_HPP
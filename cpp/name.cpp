@@ -1,69 +1,303 @@
 #include "util.hpp"
 #include "name.hpp"
 
+#include <bit>
+#include <cassert>
 #include <cstring>
 #include <ostream>
+#include <unordered_map>
+#include <utility>
+
+#include "hash.hpp"
 
 namespace brmh {
 
 // # Names
 
-Names::Names() : counter_(0), name_chars_(), by_chars_() {}
+static constexpr std::size_t INITIAL_SLOT_COUNT = 1 << 6;
+
+static std::atomic<std::uint64_t> names_serial = 1;
+
+static thread_local Names::Unit* current_unit = nullptr;
+
+Names::Shard::Shard() : mutex(), arena(), slots(INITIAL_SLOT_COUNT, Slot {0, Slot::EMPTY}), count(0) {}
+
+Names::Names()
+    : serial_(names_serial.fetch_add(1, std::memory_order_relaxed)), next_id_(0), next_number_(1), segments_(),
+      shards_()
+{}
+
+Names::~Names() {
+    for (std::atomic<Entry*>& segment : segments_) {
+        delete[] segment.load(std::memory_order_relaxed);
+    }
+}
+
+// Segment `k` holds `FIRST_SEGMENT_SIZE << k` entries, starting at id `FIRST_SEGMENT_SIZE * (2^k - 1)`:
 
-Names::~Names() { /* TODO: Free all C strings */ }
+Names::Entry& Names::entry(std::uint32_t id) {
+    std::size_t const k = std::bit_width(id / FIRST_SEGMENT_SIZE + 1) - 1;
+    std::atomic<Entry*>& segment = segments_[k];
+
+    Entry* entries = segment.load(std::memory_order_acquire);
+    if (!entries) {
+        Entry* const new_entries = new Entry[FIRST_SEGMENT_SIZE << k]();
+        if (segment.compare_exchange_strong(entries, new_entries, std::memory_order_acq_rel)) {
+            entries = new_entries;
+        } else { // Another thread got there first and `entries` is now theirs
+            delete[] new_entries;
+        }
+    }
+
+    return entries[id - FIRST_SEGMENT_SIZE * ((std::size_t(1) << k) - 1)];
+}
+
+Names::Entry const& Names::entry(std::uint32_t id) const {
+    std::size_t const k = std::bit_width(id / FIRST_SEGMENT_SIZE + 1) - 1;
+    return segments_[k].load(std::memory_order_acquire)[id - FIRST_SEGMENT_SIZE * ((std::size_t(1) << k) - 1)];
+}
 
 Name Names::sourced(const char* chars, std::size_t size) {
-    auto it = by_chars_.find(std::string_view(chars, size));
-    if (it != by_chars_.end()) {
-        return it->second;
+    return sourced(chars, size, hash_chars(std::string_view(chars, size)));
+}
+
+Name Names::sourced(const char* chars, std::size_t size, std::uint64_t hash) {
+    Shard& shard = this->shard(hash);
+    std::lock_guard<std::mutex> const lock(shard.mutex);
+
+    std::size_t const mask = shard.slots.size() - 1;
+    std::size_t i = hash & mask;
+    for (;; i = (i + 1) & mask) { // Linear probing
+        Slot const slot = shard.slots[i];
+        if (slot.id == Slot::EMPTY) { break; }
+
+        if (slot.hash == static_cast<std::uint32_t>(hash)) {
+            Entry const& entry = this->entry(slot.id);
+            if (entry.size == size && std::memcmp(entry.chars, chars, size) == 0) {
+                return Name(slot.id);
+            }
+        }
+    }
+
+    std::uint64_t const id = next_id_.fetch_add(1, std::memory_order_relaxed);
+    assert(id < Slot::EMPTY);
+    const char* const new_chars = shard.copy_chars(chars, size);
+    entry(static_cast<std::uint32_t>(id)) = Entry {new_chars, static_cast<std::uint32_t>(size), SOURCED};
+
+    shard.slots[i] = Slot {static_cast<std::uint32_t>(hash), static_cast<std::uint32_t>(id)};
+    if (++shard.count > shard.slots.size() / 2) {
+        shard.grow();
+    }
+
+    return Name(static_cast<std::uint32_t>(id));
+}
+
+const char* Names::Shard::copy_chars(const char* chars, std::size_t size) {
+    char* const new_chars = static_cast<char*>(arena.alloc_array<char>(size + 1));
+    std::memcpy(new_chars, chars, size);
+    new_chars[size] = '\0';
+    return new_chars;
+}
+
+void Names::Shard::grow() {
+    std::vector<Slot> const old_slots = std::exchange(slots, std::vector<Slot>(2 * slots.size(), Slot {0, Slot::EMPTY}));
+
+    for (Slot const slot : old_slots) {
+        if (slot.id != Slot::EMPTY) {
+            insert(slot);
+        }
+    }
+}
+
+void Names::Shard::insert(Slot slot) {
+    std::size_t const mask = slots.size() - 1;
+    std::size_t i = slot.hash & mask;
+    while (slots[i].id != Slot::EMPTY) { i = (i + 1) & mask; }
+    slots[i] = slot;
+}
+
+Name Names::fresh_entry(const char* chars, std::uint32_t size) {
+    struct Block {
+        std::uint64_t owner; // `serial_` of the `Names` that the ids are from
+        std::uint32_t next;
+        std::uint32_t end;
+    };
+    static thread_local Block block {0, 0, 0};
+
+    if (block.owner != serial_ || block.next == block.end) {
+        std::uint64_t const start = next_id_.fetch_add(FRESH_BLOCK_SIZE, std::memory_order_relaxed);
+        assert(start + FRESH_BLOCK_SIZE <= Slot::EMPTY);
+        block = Block {serial_, static_cast<std::uint32_t>(start), static_cast<std::uint32_t>(start + FRESH_BLOCK_SIZE)};
+    }
+    std::uint32_t const id = block.next++;
+
+    std::uint32_t number;
+    if (current_unit && current_unit->names_ == this) {
+        std::vector<Unit::Range>& ranges = current_unit->ranges_;
+        if (!ranges.empty() && ranges.back().end == id) {
+            ++ranges.back().end;
+        } else {
+            ranges.push_back(Unit::Range {id, id + 1});
+        }
+        number = UNNUMBERED;
     } else {
-        const Name name = fresh();
-        const char* const new_chars = strndup(chars, size);
-        name_chars_.insert({name, new_chars});
-        by_chars_.insert({new_chars, name});
-        return name;
+        number = next_number_.fetch_add(1, std::memory_order_relaxed);
     }
+
+    entry(id) = Entry {chars, size, number};
+    return Name(id);
 }
 
 Name Names::fresh(const char* chars, std::size_t size) {
-    const Name name = fresh();
-    name_chars_.insert({name, strndup(chars, size)});
-    return name;
+    Shard& shard = this->shard(hash_chars(std::string_view(chars, size)));
+    const char* new_chars;
+    {
+        std::lock_guard<std::mutex> const lock(shard.mutex);
+        new_chars = shard.copy_chars(chars, size);
+    }
+
+    return fresh_entry(new_chars, static_cast<std::uint32_t>(size));
 }
 
-Name Names::fresh() { return Name(counter_++); }
+Name Names::fresh() { return fresh_entry(nullptr, 0); }
 
 Name Names::freshen(Name name) {
-    const Name new_name = fresh();
+    Entry const& original = entry(name.id_);
+    return fresh_entry(original.chars, original.size);
+}
 
-    auto it = name_chars_.find(name);
-    if (it != name_chars_.end()) {
-        name_chars_.insert({new_name, it->second});
-    }
+// ## Units
+
+Names::UnitScope::UnitScope(Unit& unit) : outer_(std::exchange(current_unit, &unit)) {}
 
-    return new_name;
+Names::UnitScope::~UnitScope() { current_unit = outer_; }
+
+void Names::number(Unit& unit) {
+    std::uint32_t number = next_number_.load(std::memory_order_relaxed);
+    for (Unit::Range const range : unit.ranges_) {
+        for (std::uint32_t id = range.start; id < range.end; ++id) {
+            entry(id).number = number++;
+        }
+    }
+    next_number_.store(number, std::memory_order_relaxed);
+    unit.ranges_.clear();
 }
 
 void Names::print_name(Name name, std::ostream& dest) const {
-    auto it = name_chars_.find(name);
-    if (it != name_chars_.end()) {
-        dest << it->second;
+    Entry const& entry = this->entry(name.id_);
+
+    if (entry.chars) {
+        dest << entry.chars;
+    }
+
+    if (entry.number != SOURCED) {
+        assert(entry.number != UNNUMBERED); // Its `Unit` should have been `number`ed by now
+        dest << '$' << entry.number;
+    }
+}
+
+// ## Compaction
+
+Names::Compaction::Stats Names::Compaction::finish() {
+    std::size_t const id_count = names_.next_id_.load(std::memory_order_relaxed);
+    assert(id_count <= RENAMED); // So that ids never have the `RENAMED` bit
+
+    // Mark, then number the live ids in order. Ids that were never handed out still have a zeroed `Entry`:
+    std::size_t issued_count = 0;
+    for (std::size_t id = 0; id < id_count; ++id) {
+        if (names_.entry(static_cast<std::uint32_t>(id)).number != 0) { ++issued_count; }
+    }
+    std::vector<std::uint32_t> new_ids(id_count, Slot::EMPTY);
+    for (Name const* const ref : refs_) {
+        new_ids[ref->id_] = 0;
     }
+    std::uint32_t live_count = 0;
+    for (std::uint32_t& new_id : new_ids) {
+        if (new_id != Slot::EMPTY) { new_id = live_count++; }
+    }
+
+    // Copy the live entries and their chars (once, since `freshen` shares them). The old chars must stay put until
+    // all entries have been copied, so the shards get their new arenas only at the end:
+    std::vector<Entry> entries;
+    entries.reserve(live_count);
+    std::array<BumpArena, SHARD_COUNT> arenas;
+    std::unordered_map<const char*, const char*> moved_chars;
+    for (Shard& shard : names_.shards_) {
+        shard.slots.assign(INITIAL_SLOT_COUNT, Slot {0, Slot::EMPTY});
+        shard.count = 0;
+    }
+
+    for (std::size_t id = 0; id < id_count; ++id) {
+        if (new_ids[id] == Slot::EMPTY) { continue; }
+
+        Entry entry = names_.entry(static_cast<std::uint32_t>(id));
+        if (entry.chars) {
+            // Only sourced names need to go to the shard of their hash:
+            bool const sourced = entry.number == SOURCED;
+            std::uint64_t const hash = sourced ? hash_chars(std::string_view(entry.chars, entry.size)) : id;
+            std::size_t const shard_index = sourced ? hash >> (64 - SHARD_BITS) : id % SHARD_COUNT;
+
+            auto const it = moved_chars.find(entry.chars);
+            if (it != moved_chars.end()) {
+                entry.chars = it->second;
+            } else {
+                char* const new_chars = static_cast<char*>(arenas[shard_index].alloc_array<char>(entry.size + 1));
+                std::memcpy(new_chars, entry.chars, entry.size + 1);
+                moved_chars.insert({entry.chars, new_chars});
+                entry.chars = new_chars;
+            }
+
+            if (sourced) {
+                Shard& shard = names_.shards_[shard_index];
+                shard.insert(Slot {static_cast<std::uint32_t>(hash), new_ids[id]});
+                if (++shard.count > shard.slots.size() / 2) {
+                    shard.grow();
+                }
+            }
+        }
+        entries.push_back(entry);
+    }
+
+    for (std::size_t i = 0; i < SHARD_COUNT; ++i) {
+        names_.shards_[i].arena = std::move(arenas[i]);
+    }
+
+    for (std::atomic<Entry*>& segment : names_.segments_) {
+        delete[] segment.exchange(nullptr, std::memory_order_relaxed);
+    }
+    for (std::uint32_t id = 0; id < live_count; ++id) {
+        names_.entry(id) = entries[id];
+    }
+
+    // A location may have been kept more than once, so tag the renamed ones until all are done:
+    for (Name* const ref : refs_) {
+        if (!(ref->id_ & RENAMED)) {
+            ref->id_ = new_ids[ref->id_] | RENAMED;
+        }
+    }
+    for (Name* const ref : refs_) {
+        ref->id_ &= ~RENAMED;
+    }
+    refs_.clear();
+
+    names_.next_id_.store(live_count, std::memory_order_relaxed);
+    // Discard the thread-local fresh id blocks, which point into the old numbering:
+    names_.serial_ = names_serial.fetch_add(1, std::memory_order_relaxed);
 
-    dest << '$' << name.id_;
+    return Stats {.issued = issued_count, .live = live_count, .block_slack = id_count - issued_count};
 }
 
 // # Name
 
-std::size_t Name::Hash::operator()(Name name) const noexcept { return std::hash<std::uintptr_t>()(name.id_); }
+std::size_t Name::Hash::operator()(Name name) const noexcept { return std::hash<std::uint32_t>()(name.id_); }
 
-Name::Name(uintptr_t id) : id_(id) {}
+Name::Name(std::uint32_t id) : id_(id) {}
 
 bool Name::operator==(const Name& other) const { return id_ == other.id_; }
 
 opt_ptr<const char> Name::src_name(const Names &names) const {
-    auto it = names.name_chars_.find(*this);
-    return it != names.name_chars_.end() ? opt_ptr<const char>::some(it->second) : opt_ptr<const char>::none();
+    const char* const chars = names.entry(id_).chars;
+    return chars ? opt_ptr<const char>::some(chars) : opt_ptr<const char>::none();
 }
 
 void Name::print(Names const& names, std::ostream& dest) const { names.print_name(*this, dest); }
@@ -1,10 +1,16 @@
 #ifndef BRMH_NAME_HPP
 #define BRMH_NAME_HPP
 
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <vector>
 
 #include "util.hpp"
+#include "bumparena.hpp"
 
 namespace brmh {
 
@@ -23,16 +29,33 @@ struct Name {
 private:
     friend struct Names;
 
-    explicit Name(uintptr_t id);
+    explicit Name(std::uint32_t id);
 
-    uintptr_t id_;
+    std::uint32_t id_; // Index of the `Names::Entry`
 };
 
+// Thread-safe, so that compiler stages can run in parallel:
+//
+// * Source identifiers are interned in `SHARD_COUNT` open-addressing tables, picked by the top bits of their
+//   `hash_chars`. Each has its own lock and string arena, so threads only contend when they intern names that hash to
+//   the same shard at the same time.
+// * Ids are dense, so the chars of a name are just an index away. The id -> chars table is split into segments of
+//   doubling size that never move, so lookups take no lock.
+// * Each thread takes ids for `fresh` and `freshen` a block at a time from a shared counter, so those take no lock
+//   either (unless they copy chars). Sourced names take theirs one at a time.
+//
+// Ids thus depend on how the threads interleave, so they are never printed. Sourced names are printed as just their
+// chars, which make them unique anyway. Fresh names are printed with a number in creation order instead. Outside of a
+// `Unit` that is assigned on creation, which is only deterministic while one thread at a time creates names. A parallel
+// pass instead gives each of its units of work a `Unit` and `number`s those in a fixed order afterwards, so that it
+// prints the same however the work got scheduled.
 struct Names {
     Names(const Names&) = delete;
     Names& operator=(const Names&) = delete;
 
     Name sourced(const char* chars, std::size_t size);
+    // Same as above but with a precomputed `hash_chars` of the identifier (as from `scan::hashed_alnums`):
+    Name sourced(const char* chars, std::size_t size, std::uint64_t hash);
     Name fresh(const char* chars, std::size_t size);
     Name fresh();
     Name freshen(Name name);
@@ -40,18 +63,124 @@ struct Names {
     Names();
     ~Names();
 
-    // TODO: Some sort of GC between compiler passes?
+    // The fresh names that a unit of work creates, to be numbered as a whole later; see `UnitScope` and `number`.
+    // Which thread creates them does not matter:
+    class Unit {
+    public:
+        explicit Unit(Names& names) : names_(&names), ranges_() {}
+
+    private:
+        friend struct Names;
+
+        struct Range {
+            std::uint32_t start;
+            std::uint32_t end;
+        };
+
+        Names* names_;
+        std::vector<Range> ranges_; // Of ids, in creation order. Consecutive ids from one block share a `Range`.
+    };
+
+    // Makes the fresh names of its `Names` that this thread creates go into `unit` until the scope exits:
+    class UnitScope {
+    public:
+        explicit UnitScope(Unit& unit);
+        ~UnitScope();
+
+        UnitScope(UnitScope const&) = delete;
+        UnitScope& operator=(UnitScope const&) = delete;
+
+    private:
+        Unit* outer_;
+    };
+
+    // Numbers the names of `unit`, in creation order, after all the fresh names numbered so far. Must be done before
+    // they are printed or compacted away, and not concurrently with creating fresh names:
+    void number(Unit& unit);
+
+    // Garbage collection between compiler passes: every `Name` that is still in use gets `keep`:t, then `finish`
+    // renumbers their ids densely (printed numbers stay the same) and drops all the other names, along with their
+    // chars. No other thread may use the `Names` in the meantime.
+    class Compaction {
+    public:
+        struct Stats {
+            std::size_t issued; // Ids in use: the ones that the last compaction kept and all handed out since
+            std::size_t live; // Of those, the ones that were kept; ids are `0..live` afterwards
+            std::size_t block_slack; // Ids that fresh id blocks took from the counter but never handed out
+        };
+
+        explicit Compaction(Names& names) : names_(names), refs_() {}
+
+        Compaction(Compaction const&) = delete;
+        Compaction& operator=(Compaction const&) = delete;
+
+        // `name` gets updated in place by `finish`, so it must not move before that. Keeping it more than once is
+        // fine:
+        void keep(Name& name) { refs_.push_back(&name); }
+
+        Stats finish();
+
+    private:
+        static constexpr std::uint32_t RENAMED = std::uint32_t(1) << 31;
+
+        Names& names_;
+        std::vector<Name*> refs_;
+    };
 
 private:
     friend struct Name;
 
-    void print_name(Name name, std::ostream& dest) const;
+    static constexpr std::size_t SHARD_BITS = 4;
+    static constexpr std::size_t SHARD_COUNT = 1 << SHARD_BITS;
+    static constexpr std::uint32_t FRESH_BLOCK_SIZE = 256;
+    static constexpr std::size_t FIRST_SEGMENT_SIZE = 1 << 10;
+    static constexpr std::size_t SEGMENT_COUNT = 22; // Enough for 2^32 ids
+
+    // `Entry::number` of sourced names and of fresh names that wait for `number`ing with their `Unit`. Zero means
+    // that the id was never handed out:
+    static constexpr std::uint32_t SOURCED = UINT32_MAX;
+    static constexpr std::uint32_t UNNUMBERED = UINT32_MAX - 1;
+
+    struct Entry {
+        const char* chars; // NUL-terminated; nullptr for anonymous names
+        std::uint32_t size;
+        std::uint32_t number; // Printed number of fresh names, from 1
+    };
+
+    struct Slot {
+        static constexpr std::uint32_t EMPTY = UINT32_MAX;
+
+        std::uint32_t hash; // Low bits of the `hash_chars`
+        std::uint32_t id; // `EMPTY` for vacant slots
+    };
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        BumpArena arena;
+        std::vector<Slot> slots; // Power of two sized, at most half full
+        std::size_t count;
 
-    // FIXME: Thread safety:
+        Shard();
+
+        const char* copy_chars(const char* chars, std::size_t size); // `mutex` must be held
+        void grow(); // `mutex` must be held
+        void insert(Slot slot); // `mutex` must be held, does not `grow`
+    };
+
+    Shard& shard(std::uint64_t hash) { return shards_[hash >> (64 - SHARD_BITS)]; }
+
+    Entry& entry(std::uint32_t id); // Allocates the segment if need be
+    Entry const& entry(std::uint32_t id) const; // The id must have been created
+
+    Name fresh_entry(const char* chars, std::uint32_t size); // Takes a fresh id and fills in its `Entry`
+
+    void print_name(Name name, std::ostream& dest) const;
 
-    std::size_t counter_;
-    std::unordered_map<Name, const char*, Name::Hash> name_chars_;
-    std::unordered_map<std::string_view, Name> by_chars_;
+    std::uint64_t serial_; // Tells apart instances (and compactions), for the thread-local fresh id blocks
+    std::atomic<std::uint64_t> next_id_;
+    std::atomic<std::uint32_t> next_number_;
+    std::array<std::atomic<Entry*>, SEGMENT_COUNT> segments_;
+    std::array<Shard, SHARD_COUNT> shards_;
 };
 
 } // namespace brmh
@@ -0,0 +1,71 @@
+#ifndef BRMH_PARALLEL_HPP
+#define BRMH_PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace brmh {
+
+// Default worker count; at least 1 even if the platform cannot tell:
+inline std::size_t hardware_threads() {
+    return std::max<std::size_t>(1, std::thread::hardware_concurrency());
+}
+
+// Number of threads that `parallel_for` runs `count` items on:
+inline std::size_t worker_count(std::size_t count, std::size_t max_threads) {
+    return std::min(count, std::max<std::size_t>(1, max_threads));
+}
+
+// Call `f(worker, i)` for every `i` in `[0, count)` on up to `max_threads` threads (including the calling one, which is
+// worker 0). `worker` is the index of the calling thread, below `worker_count(count, max_threads)`, for per-thread state.
+// Workers pull indices from a shared counter in increasing order, so items of uneven cost (e.g. files of different
+// sizes) balance out.
+//
+// If some calls throw, the exception from the lowest `i` is rethrown after all the workers have finished, so the
+// error that gets reported does not depend on thread timing.
+template<typename F>
+void parallel_for_workers(std::size_t count, std::size_t max_threads, F const& f) {
+    if (count == 0) { return; }
+
+    std::vector<std::exception_ptr> errors(count);
+    std::atomic<std::size_t> next = 0;
+
+    auto const work = [&] (std::size_t worker) {
+        for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count;) {
+            try {
+                f(worker, i);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    std::size_t const thread_count = worker_count(count, max_threads);
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+    for (std::size_t i = 1; i < thread_count; ++i) {
+        threads.emplace_back(work, i);
+    }
+    work(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    for (std::exception_ptr const& error : errors) {
+        if (error) { std::rethrow_exception(error); }
+    }
+}
+
+// Call `f(i)` for every `i` in `[0, count)`, as above:
+template<typename F>
+void parallel_for(std::size_t count, std::size_t max_threads, F const& f) {
+    parallel_for_workers(count, max_threads, [&] (std::size_t, std::size_t i) { f(i); });
+}
+
+} // namespace brmh
+
+#endif // BRMH_PARALLEL_HPP
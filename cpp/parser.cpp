@@ -2,6 +2,8 @@
 
 #include <cstring>
 
+#include "perfecthash.hpp"
+
 namespace brmh {
 
 // # Parser::Error
@@ -12,260 +14,396 @@ const char* Parser::Error::what() const noexcept { return "ParseError"; }
 
 // # Parser
 
-Parser::Parser(Lexer&& lexer, Names& names, type::Types& types) : lexer_(lexer), names_(names), types_(types) {}
+static constexpr PerfectHashMap<ast::PrimApp::Op, 4> PRIMOPS({{
+    {"__addWI64", ast::PrimApp::Op::ADD_W_I64},
+    {"__subWI64", ast::PrimApp::Op::SUB_W_I64},
+    {"__mulWI64", ast::PrimApp::Op::MUL_W_I64},
+    {"__eqI64", ast::PrimApp::Op::EQ_I64}
+}});
 
-ast::Program Parser::program() {
-    return ast::Program(parse_defs());
+Parser::Parser(TokenBuffer const& tokens, Names& names, type::Types& types)
+    : tokens_(tokens), index_(0), names_(names), types_(types), program_(),
+      frames_(), expr_stack_(), stmt_stack_(), pat_stack_() {}
+
+optional<Lexer::Token> Parser::peek() const {
+    return index_ < tokens_.size() ? optional(tokens_.at(index_)) : optional<Lexer::Token>();
+}
+
+Lexer::Token Parser::peek_some() const {
+    if (index_ < tokens_.size()) {
+        return tokens_.at(index_);
+    } else {
+        throw Error(tokens_.end_pos()); // Unexpected end of input
+    }
+}
+
+Lexer::Token::Type Parser::peek_type() const {
+    if (index_ < tokens_.size()) {
+        return tokens_.types[index_];
+    } else {
+        throw Error(tokens_.end_pos()); // Unexpected end of input
+    }
+}
+
+void Parser::next() {
+    if (index_ < tokens_.size()) { ++index_; }
+}
+
+void Parser::match(Lexer::Token::Type type) {
+    if (index_ < tokens_.size() && tokens_.types[index_] == type) { ++index_; }
 }
 
-std::vector<ast::Def*> Parser::parse_defs() {
-    std::vector<ast::Def*> defs;
+Pos Parser::next_start() const {
+    return index_ < tokens_.size() ? Pos {tokens_.file, tokens_.offsets[index_]} : tokens_.end_pos();
+}
+
+Pos Parser::prev_end() const {
+    return index_ > 0
+            ? Pos {tokens_.file, tokens_.offsets[index_ - 1] + tokens_.sizes[index_ - 1]}
+            : Pos {tokens_.file, 0};
+}
 
+ast::Program Parser::program() {
+    parse_defs();
+    return std::move(program_);
+}
+
+void Parser::parse_defs() {
     while (true) {
-        const auto tok = lexer_.peek();
+        const auto tok = peek();
         if (tok) {
             switch (tok->typ) {
             case Lexer::Token::Type::FUN: {
-                defs.push_back(parse_fundef());
+                program_.push_toplevel(parse_fundef());
                 break;
             }
 
-            default: throw Error(tok->span.start);
+            default: throw Error(tok->span.start_pos());
             }
         } else {
-            return defs;
+            return;
         }
     }
 }
 
-ast::FunDef* Parser::parse_fundef() {
-    const Pos start_pos = lexer_.pos();
+ast::Def Parser::parse_fundef() {
+    const Pos start_pos = next_start();
 
-    lexer_.next(); // Discard `fun`
+    next(); // Discard `fun`
 
     const auto name = parse_id();
 
-    std::vector<ast::Pat*> params;
-    lexer_.match(Lexer::Token::Type::LPAREN); // Discard '('
+    std::size_t const params_base = pat_stack_.size();
+    match(Lexer::Token::Type::LPAREN); // Discard '('
 
-    if (lexer_.peek_some().typ == Lexer::Token::Type::RPAREN) {
-        lexer_.next(); // Discard ')'
+    if (peek_type() == Lexer::Token::Type::RPAREN) {
+        next(); // Discard ')'
     } else {
-        params.push_back(parse_pat());
+        pat_stack_.push_back(parse_pat());
 
-        while (lexer_.peek_some().typ == Lexer::Token::Type::COMMA) {
-            lexer_.next(); // Discard ','
-            params.push_back(parse_pat());
+        while (peek_type() == Lexer::Token::Type::COMMA) {
+            next(); // Discard ','
+            pat_stack_.push_back(parse_pat());
         }
 
-        lexer_.match(Lexer::Token::Type::RPAREN); // Discard ')'
+        match(Lexer::Token::Type::RPAREN); // Discard ')'
     }
 
-    lexer_.match(Lexer::Token::Type::COLON); // Discard ':'
+    match(Lexer::Token::Type::COLON); // Discard ':'
     const auto codomain = parse_type();
 
     const auto body = parse_block();
 
-    const Pos end_pos = lexer_.pos();
+    const Pos end_pos = prev_end();
 
-    return new ast::FunDef(Span{start_pos, end_pos}, name, std::move(params), codomain, body);
+    ast::Range const params = program_.pats(std::span<ast::Pat const>(pat_stack_).subspan(params_base));
+    pat_stack_.erase(pat_stack_.begin() + params_base, pat_stack_.end());
+    return program_.fun_def(Span{start_pos, end_pos}, name, params, codomain, body);
 }
 
 // block ::= '{' (stmt ';')* expr '}'
-ast::Block* Parser::parse_block() {
-    auto const start_pos = lexer_.pos();
+ast::Expr Parser::parse_block() { return parse_expr(true); }
 
-    // Discard '{':
-    assert(lexer_.peek_some().typ == Lexer::Token::Type::LBRACE);
-    lexer_.next();
+// expr ::= callee arglist*
+ast::Expr Parser::expr() { return parse_expr(false); }
+
+// Parse an `expr` (or just a `block` if `block_only`). Instead of recursing into subexpressions this keeps their
+// unfinished parents in `frames_`, so nesting depth is only limited by heap memory:
+ast::Expr Parser::parse_expr(bool block_only) {
+    std::size_t const floor = frames_.size();
+
+    ast::Expr expr = descend(block_only);
+    while (frames_.size() > floor) {
+        Frame& frame = frames_.back();
+        switch (frame.kind) {
+        case Frame::Kind::CALLEE: { // `expr` is the callee or the latest call
+            if (peek_type() == Lexer::Token::Type::LPAREN) {
+                next(); // Discard '('
+                expr_stack_.push_back(expr);
+                frame.kind = Frame::Kind::ARG;
+                frame.base = expr_stack_.size();
+
+                if (peek_type() == Lexer::Token::Type::RPAREN) {
+                    next(); // Discard ')'
+                    expr = pop_call(frame);
+                } else {
+                    expr = descend(false);
+                }
+            } else {
+                frames_.pop_back();
+            }
+            break;
+        }
 
-    std::vector<ast::Stmt*> stmts;
-    while (lexer_.peek_some().typ == Lexer::Token::Type::VAL) {
-        stmts.push_back(parse_stmt());
-        lexer_.match(Lexer::Token::Type::SEMICOLON); // Discard ';'
-    }
+        case Frame::Kind::ARG: {
+            expr_stack_.push_back(expr);
 
-    auto const body = expr();
+            if (peek_type() == Lexer::Token::Type::COMMA) {
+                next(); // Discard ','
+                expr = descend(false);
+            } else {
+                match(Lexer::Token::Type::RPAREN); // Discard ')'
+                expr = pop_call(frame);
+            }
+            break;
+        }
 
-    lexer_.match(Lexer::Token::Type::RBRACE); // Discard '}'
+        case Frame::Kind::PRIM_ARG: {
+            expr_stack_.push_back(expr);
+
+            if (peek_type() == Lexer::Token::Type::COMMA) {
+                next(); // Discard ','
+                expr = descend(false);
+            } else {
+                match(Lexer::Token::Type::RPAREN); // Discard ')'
+                Span const span{frame.start_pos, prev_end()};
+                expr = program_.prim_app(span, frame.op, pop_exprs(frame.base));
+                frames_.pop_back();
+            }
+            break;
+        }
 
-    Span span{start_pos, lexer_.pos()};
-    return new ast::Block(span, std::move(stmts), body);
-}
+        case Frame::Kind::VAL: {
+            ast::Pat const pat = pat_stack_.back();
+            pat_stack_.pop_back();
+            Span const span{frame.start_pos, program_.span(expr).end_pos()};
+            stmt_stack_.push_back(program_.val(span, pat, expr));
+            frames_.pop_back();
+
+            match(Lexer::Token::Type::SEMICOLON); // Discard ';'
+            open_stmt();
+            expr = descend(false);
+            break;
+        }
 
-// expr ::= callee arglist*
-ast::Expr* Parser::expr() {
-    ast::Expr* expr = parse_callee();
-    Pos const start_pos = expr->span.start;
-
-    while (lexer_.peek_some().typ == Lexer::Token::Type::LPAREN) {
-        std::vector<ast::Expr*> args = parse_arglist();
-        const Pos end_pos = lexer_.pos();
-        expr = new ast::Call(Span{start_pos, end_pos}, expr, std::move(args));
+        case Frame::Kind::BLOCK: { // `expr` is the body
+            match(Lexer::Token::Type::RBRACE); // Discard '}'
+
+            Span const span{frame.start_pos, prev_end()};
+            ast::Range const stmts = program_.stmts(std::span<ast::Stmt const>(stmt_stack_).subspan(frame.base));
+            stmt_stack_.erase(stmt_stack_.begin() + frame.base, stmt_stack_.end());
+            expr = program_.block(span, stmts, expr);
+            frames_.pop_back();
+            break;
+        }
+
+        case Frame::Kind::IF_COND: {
+            expr_stack_.push_back(expr);
+            frame.kind = Frame::Kind::IF_CONSEQ;
+            expr = descend(true);
+            break;
+        }
+
+        case Frame::Kind::IF_CONSEQ: {
+            expr_stack_.push_back(expr);
+            frame.kind = Frame::Kind::IF_ALT;
+            match(Lexer::Token::Type::ELSE); // Discard "else"
+            expr = descend(true);
+            break;
+        }
+
+        case Frame::Kind::IF_ALT: {
+            ast::Expr const conseq = expr_stack_.back();
+            expr_stack_.pop_back();
+            ast::Expr const cond = expr_stack_.back();
+            expr_stack_.pop_back();
+
+            Span const span{frame.start_pos, prev_end()};
+            expr = program_.if_(span, cond, conseq, expr);
+            frames_.pop_back();
+            break;
+        }
+        }
     }
 
     return expr;
 }
 
-std::vector<ast::Expr*> Parser::parse_arglist() {
-    std::vector<ast::Expr*> args;
-    lexer_.match(Lexer::Token::Type::LPAREN); // Discard '('
-
-    if (lexer_.peek_some().typ == Lexer::Token::Type::RPAREN) {
-        lexer_.next(); // Discard ')'
-    } else {
-        args.push_back(expr());
+// Push frames for enclosing nodes until reaching a subexpression that is complete without any more of them:
+ast::Expr Parser::descend(bool block_only) {
+    while (true) {
+        const auto tok = peek_some();
+        if (block_only && tok.typ != Lexer::Token::Type::LBRACE) { throw Error(tok.span.start_pos()); }
+
+        // Leaves only need a frame if an arglist follows them:
+        bool const callee = !block_only;
+        block_only = false;
+
+        switch (tok.typ) {
+        case Lexer::Token::Type::LBRACE: {
+            if (callee) { frames_.push_back(Frame {Frame::Kind::CALLEE, {}, tok.span.start_pos(), 0}); }
+            next(); // Discard '{'
+            frames_.push_back(Frame {Frame::Kind::BLOCK, {}, tok.span.start_pos(), stmt_stack_.size()});
+            open_stmt();
+            break;
+        }
 
-        while (lexer_.peek_some().typ == Lexer::Token::Type::COMMA) {
-            lexer_.next(); // Discard ','
-            args.push_back(expr());
+        case Lexer::Token::Type::IF: {
+            frames_.push_back(Frame {Frame::Kind::CALLEE, {}, tok.span.start_pos(), 0});
+            next(); // Discard "if"
+            frames_.push_back(Frame {Frame::Kind::IF_COND, {}, tok.span.start_pos(), 0});
+            break;
         }
 
-        lexer_.match(Lexer::Token::Type::RPAREN); // Discard ')'
-    }
+        case Lexer::Token::Type::PRIMOP: {
+            frames_.push_back(Frame {Frame::Kind::CALLEE, {}, tok.span.start_pos(), 0});
+            next();
 
-    return args;
-}
+            // TODO: Check op existence in typing, not parsing:
+            std::optional<ast::PrimApp::Op> const op = PRIMOPS.find(tok.chars, tok.size);
+            if (!op) { throw Error(tok.span.start_pos()); }
 
-ast::Expr* Parser::parse_callee() {
-    const auto tok = lexer_.peek_some();
-    switch (tok.typ) {
-    case Lexer::Token::Type::LBRACE: return parse_block();
+            match(Lexer::Token::Type::LPAREN); // Discard '('
 
-    case Lexer::Token::Type::IF: {
-        auto const if_tok = tok;
+            if (peek_type() == Lexer::Token::Type::RPAREN) {
+                next(); // Discard ')'
+                return program_.prim_app(Span{tok.span.start_pos(), prev_end()}, *op, ast::Range {0, 0});
+            }
 
-        lexer_.next(); // Discard "if"
-        auto const cond = expr();
-        auto const conseq = parse_block();
-        lexer_.match(Lexer::Token::Type::ELSE); // Discard "else"
-        auto const alt = parse_block();
+            frames_.push_back(Frame {Frame::Kind::PRIM_ARG, *op, tok.span.start_pos(), expr_stack_.size()});
+            break;
+        }
 
-        Span span{if_tok.span.start, lexer_.pos()};
-        return new ast::If(span, cond, conseq, alt);
-    }
+        case Lexer::Token::Type::ID: {
+            next();
 
-    case Lexer::Token::Type::PRIMOP: {
-        const auto op_tok = tok;
-        lexer_.next();
-
-        // TODO: Check op existence in typing, not parsing:
-        ast::PrimApp::Op const op = strncmp(op_tok.chars, "__addWI64", op_tok.size) == 0
-                ? ast::PrimApp::Op::ADD_W_I64
-                : strncmp(op_tok.chars, "__subWI64", op_tok.size) == 0
-                  ? ast::PrimApp::Op::SUB_W_I64
-                  : strncmp(op_tok.chars, "__mulWI64", op_tok.size) == 0
-                    ? ast::PrimApp::Op::MUL_W_I64
-                    : strncmp(op_tok.chars, "__eqI64", op_tok.size) == 0
-                      ? ast::PrimApp::Op::EQ_I64
-                      :  throw Error(op_tok.span.start);
-
-        std::vector<ast::Expr*> args = parse_arglist();
-
-        Span span{op_tok.span.start, lexer_.pos()};
-        return new ast::PrimApp(span, op, std::move(args));
-    }
+            return leaf(callee, program_.id(tok.span, tok.payload.name));
+        }
 
-    case Lexer::Token::Type::ID: {
-        lexer_.next();
+        case Lexer::Token::Type::TRUE: {
+            next();
 
-        return new ast::Id(tok.span, names_.sourced(tok.chars, tok.size));
-    }
+            return leaf(callee, program_.const_bool(tok.span, true));
+        }
 
-    case Lexer::Token::Type::TRUE: {
-        lexer_.next();
+        case Lexer::Token::Type::FALSE: {
+            next();
 
-        return new ast::Bool(tok.span, true);
-    }
+            return leaf(callee, program_.const_bool(tok.span, false));
+        }
 
-    case Lexer::Token::Type::FALSE: {
-        lexer_.next();
+        case Lexer::Token::Type::INT: {
+            next();
 
-        return new ast::Bool(tok.span, false);
-    }
+            return leaf(callee, program_.const_int(tok.span, tok.payload.i64));
+        }
 
-    case Lexer::Token::Type::INT: {
-        lexer_.next();
+        default: throw Error(tok.span.start_pos());
+        }
+    }
+}
 
-        return new ast::Int(tok.span, tok.chars, tok.size);
+// Leaves are complete unless they are callees:
+ast::Expr Parser::leaf(bool callee, ast::Expr expr) {
+    if (callee && peek_type() == Lexer::Token::Type::LPAREN) {
+        frames_.push_back(Frame {Frame::Kind::CALLEE, {}, program_.span(expr).start_pos(), 0});
     }
+    return expr;
+}
 
-    default: throw Error(tok.span.start);
+// stmt ::= 'val' pat '=' expr
+//
+// In a block, start the next statement if there is one. Its `expr` is left for the caller, as is the body otherwise.
+void Parser::open_stmt() {
+    const auto tok = peek_some();
+    if (tok.typ == Lexer::Token::Type::VAL) {
+        next(); // Discard "val"
+        pat_stack_.push_back(parse_pat());
+        match(Lexer::Token::Type::EQUALS); // Discard '='
+        frames_.push_back(Frame {Frame::Kind::VAL, {}, tok.span.start_pos(), 0});
     }
 }
 
+// Complete the call whose callee and arguments are on top of `expr_stack_`:
+ast::Expr Parser::pop_call(Frame& frame) {
+    ast::Range const args = pop_exprs(frame.base);
+    ast::Expr const callee = expr_stack_.back();
+    expr_stack_.pop_back();
+
+    frame.kind = Frame::Kind::CALLEE; // There may be more arglists
+    return program_.call(Span{frame.start_pos, prev_end()}, callee, args);
+}
+
+ast::Range Parser::pop_exprs(std::size_t base) {
+    ast::Range const exprs = program_.exprs(std::span<ast::Expr const>(expr_stack_).subspan(base));
+    expr_stack_.erase(expr_stack_.begin() + base, expr_stack_.end());
+    return exprs;
+}
+
 // pat ::= unann_pat (':' type)*
-ast::Pat* Parser::parse_pat() {
-    ast::Pat* pat = parse_unann_pat();
-    Pos const start_pos = pat->span.start;
+ast::Pat Parser::parse_pat() {
+    ast::Pat pat = parse_unann_pat();
+    Pos const start_pos = program_.span(pat).start_pos();
 
-    while (lexer_.peek_some().typ == Lexer::Token::Type::COLON) {
-        lexer_.next(); // Discard ":"
+    while (peek_type() == Lexer::Token::Type::COLON) {
+        next(); // Discard ":"
         type::Type* const type = parse_type();
-        Span span{start_pos, lexer_.pos()};
-        pat = new ast::AnnPat(span, pat, type);
+        Span span{start_pos, prev_end()};
+        pat = program_.ann_pat(span, pat, type);
     }
 
     return pat;
 }
 
-ast::Pat* Parser::parse_unann_pat() {
-    const auto tok = lexer_.peek_some();
+ast::Pat Parser::parse_unann_pat() {
+    const auto tok = peek_some();
     switch (tok.typ) {
     case Lexer::Token::Type::ID: {
-        lexer_.next();
-
-        return new ast::IdPat(tok.span, names_.sourced(tok.chars, tok.size));
-    }
+        next();
 
-    default: throw Error(tok.span.start);
-    }
-}
-
-ast::Stmt* Parser::parse_stmt() {
-    const auto tok = lexer_.peek_some();
-    switch (tok.typ) {
-    case Lexer::Token::Type::VAL: { // 'val' pat '=' expr
-        auto const start_pos = tok.span.start;
-        lexer_.next(); // Discard "val"
-        auto const pat = parse_pat();
-        lexer_.match(Lexer::Token::Type::EQUALS); // Discard '='
-        auto const val_expr = expr();
-
-        Span span{start_pos, val_expr->span.end};
-        return new ast::Val(span, pat, val_expr);
+        return program_.id_pat(tok.span, tok.payload.name);
     }
 
-    default: throw Error(tok.span.start);
+    default: throw Error(tok.span.start_pos());
     }
 }
 
 type::Type* Parser::parse_type() {
-    const auto tok = lexer_.peek_some();
+    const auto tok = peek_some();
     switch (tok.typ) {
     case Lexer::Token::Type::BOOL: {
-        lexer_.next();
+        next();
         return types_.get_bool();
     }
 
     case Lexer::Token::Type::I64_T: {
-        lexer_.next();
+        next();
         return types_.get_i64();
     }
 
-    default: throw Error(tok.span.start);
+    default: throw Error(tok.span.start_pos());
     }
 }
 
 Name Parser::parse_id() {
-    const auto tok = lexer_.peek_some();
+    const auto tok = peek_some();
     switch (tok.typ) {
     case Lexer::Token::Type::ID: {
-        lexer_.next();
-        return names_.sourced(tok.chars, tok.size);
+        next();
+        return tok.payload.name;
     }
 
-    default: throw Error(tok.span.start);
+    default: throw Error(tok.span.start_pos());
     }
 }
 
@@ -18,31 +18,71 @@ struct Parser {
         Pos pos;
     };
 
-    explicit Parser(Lexer&& lexer, Names& names, type::Types& types);
+    Parser(TokenBuffer const& tokens, Names& names, type::Types& types);
 
     // FIXME: Proper error handling:
 
+    // Parse the whole file. Can only be called once since the nodes are allocated in the returned `Program`.
     ast::Program program();
-    ast::Expr* expr();
+    ast::Expr expr();
     type::Type* parse_type();
 
 private:
-    ast::Expr* parse_callee();
-    std::vector<ast::Expr*> parse_arglist();
-    Name parse_id();
-    ast::Block* parse_block();
+    optional<Lexer::Token> peek() const;
+    Lexer::Token peek_some() const;
+    Lexer::Token::Type peek_type() const; // Like `peek_some().typ` but without gathering the whole token
+    void next();
+    void match(Lexer::Token::Type type);
+    Pos next_start() const; // Start of the next token
+    Pos prev_end() const; // End of the last consumed token
+
+    struct Frame;
 
-    ast::Stmt* parse_stmt();
+    ast::Expr parse_expr(bool block_only);
+    ast::Expr descend(bool block_only);
+    ast::Expr leaf(bool callee, ast::Expr expr);
+    void open_stmt();
+    ast::Expr pop_call(Frame& frame);
+    ast::Range pop_exprs(std::size_t base);
+    Name parse_id();
+    ast::Expr parse_block();
 
-    ast::Pat* parse_pat();
-    ast::Pat* parse_unann_pat();
+    ast::Pat parse_pat();
+    ast::Pat parse_unann_pat();
 
-    std::vector<ast::Def*> parse_defs();
-    ast::FunDef* parse_fundef();
+    void parse_defs();
+    ast::Def parse_fundef();
 
-    Lexer lexer_;
+    TokenBuffer const& tokens_;
+    std::size_t index_;
     Names& names_;
     type::Types& types_;
+    ast::Program program_;
+
+    // Unfinished nodes enclosing the expression being parsed:
+    struct Frame {
+        enum struct Kind : std::uint8_t {
+            CALLEE, // Callee or call in `callee arglist*`
+            ARG, // Call with callee at `expr_stack_[base - 1]` and arguments from `base`
+            PRIM_ARG, // Application of `op` with arguments from `expr_stack_[base]`
+            VAL, // `val` statement with pattern on top of `pat_stack_`
+            BLOCK, // Block with statements from `stmt_stack_[base]`, awaiting its body
+            IF_COND, IF_CONSEQ, IF_ALT // `if` with the preceding parts on top of `expr_stack_`
+        };
+
+        Kind kind;
+        ast::PrimApp::Op op;
+        Pos start_pos;
+        std::size_t base;
+    };
+
+    std::vector<Frame> frames_;
+
+    // Child lists and operands under construction; nested lists are pushed on top and popped into `program_` when
+    // complete:
+    std::vector<ast::Expr> expr_stack_;
+    std::vector<ast::Stmt> stmt_stack_;
+    std::vector<ast::Pat> pat_stack_;
 };
 
 } // namespace brmh
@@ -0,0 +1,79 @@
+#ifndef BRMH_PERFECTHASH_HPP
+#define BRMH_PERFECTHASH_HPP
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+#include "hash.hpp"
+
+namespace brmh {
+
+// Immutable string-keyed map with a collision-free table, built at compile time from a list of entries. A
+// lookup costs one `hash_chars` (or none if the caller already has the hash), one multiply-shift and at most one
+// `memcmp`.
+template<typename V, std::size_t N>
+class PerfectHashMap {
+    static constexpr std::size_t BITS = [] {
+        std::size_t bits = 1;
+        while ((std::size_t(1) << bits) < 2 * N) { ++bits; } // Load factor <= 1/2 keeps the seed search short
+        return bits;
+    }();
+    static constexpr std::size_t CAPACITY = std::size_t(1) << BITS;
+
+    struct Slot {
+        std::string_view key; // Empty for vacant slots
+        V value;
+    };
+
+    std::array<Slot, CAPACITY> slots_;
+    std::uint64_t multiplier_;
+
+    constexpr std::size_t index(std::uint64_t hash) const { return (hash * multiplier_) >> (64 - BITS); }
+
+public:
+    constexpr explicit PerfectHashMap(std::array<std::pair<std::string_view, V>, N> const& entries)
+        : slots_(), multiplier_(0x9e3779b97f4a7c15)
+    {
+        for (auto const& entry : entries) {
+            if (entry.first.empty()) { throw "PerfectHashMap: empty key"; }
+        }
+
+        // Search for a multiplier that maps every key to a distinct slot:
+        for (;; multiplier_ += 2) {
+            slots_ = {};
+
+            bool collided = false;
+            for (auto const& entry : entries) {
+                Slot& slot = slots_[index(hash_chars(entry.first))];
+                if (!slot.key.empty()) {
+                    if (slot.key == entry.first) { throw "PerfectHashMap: duplicate key"; }
+
+                    collided = true;
+                    break;
+                }
+                slot = Slot {entry.first, entry.second};
+            }
+
+            if (!collided) { return; }
+        }
+    }
+
+    std::optional<V> find(const char* chars, std::size_t size) const {
+        return find(chars, size, hash_chars(std::string_view(chars, size)));
+    }
+
+    std::optional<V> find(const char* chars, std::size_t size, std::uint64_t hash) const {
+        Slot const& slot = slots_[index(hash)];
+        return slot.key.size() == size && std::memcmp(slot.key.data(), chars, size) == 0
+                ? std::optional<V>(slot.value)
+                : std::optional<V>();
+    }
+};
+
+} // namespace brmh
+
+#endif // BRMH_PERFECTHASH_HPP
@@ -1,11 +1,12 @@
 #include "pos.hpp"
 
-#include "filename.hpp"
+#include "sourcemap.hpp"
 
 namespace brmh {
 
-void Pos::print(std::ostream& out) const {
-    out << filename.c_str() << " @ " << line << ':' << column;
+void Pos::print(SourceMap const& sources, std::ostream& out) const {
+    SourceMap::LineCol const line_col = sources.line_col(*this);
+    out << sources.filename(file).c_str() << " @ " << line_col.line << ':' << line_col.column;
 }
 
 } // namespace brmh
@@ -1,27 +1,22 @@
 #ifndef BRMH_POS_H
 #define BRMH_POS_H
 
+#include <cstdint>
 #include <ostream>
 
-#include "filename.hpp"
-
 namespace brmh {
 
-struct Pos {
-    Filename filename;
-    std::size_t line;
-    std::size_t column;
+struct SourceMap;
 
-    Pos(Filename filename_, std::size_t line_, std::size_t column_)
-        : filename(filename_), line(line_), column(column_) {}
+// Index of a source file in the `SourceMap`:
+using FileId = std::uint32_t;
 
-    void print(std::ostream& out) const;
+// Byte offset into a source file. Line and column are only computed (by the `SourceMap`) for diagnostics.
+struct Pos {
+    FileId file;
+    std::uint32_t offset;
 
-    Pos next(char c) {
-        return c != '\n' ?
-                    Pos(filename, line, column + 1)
-                  : Pos(filename, line + 1, 1);
-    }
+    void print(SourceMap const& sources, std::ostream& out) const;
 };
 
 } // namespace brmh
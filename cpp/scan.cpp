@@ -0,0 +1,175 @@
+#include "scan.hpp"
+
+#include <array>
+
+#include "hash.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace brmh::scan {
+
+// # Scalar Classification
+
+enum CharClass : std::uint8_t {
+    SPACE = 1 << 0,
+    DIGIT = 1 << 1,
+    ALPHA = 1 << 2
+};
+
+static constexpr std::array<std::uint8_t, 256> CHAR_CLASSES = [] {
+    std::array<std::uint8_t, 256> classes{};
+
+    for (unsigned char c : {' ', '\t', '\n', '\v', '\f', '\r'}) { classes[c] = SPACE; }
+    for (unsigned char c = '0'; c <= '9'; ++c) { classes[c] = DIGIT; }
+    for (unsigned char c = 'a'; c <= 'z'; ++c) { classes[c] = ALPHA; }
+    for (unsigned char c = 'A'; c <= 'Z'; ++c) { classes[c] = ALPHA; }
+
+    return classes;
+}();
+
+static inline std::uint8_t char_class(char c) { return CHAR_CLASSES[static_cast<unsigned char>(c)]; }
+
+bool is_space(char c) { return char_class(c) & SPACE; }
+bool is_alpha(char c) { return char_class(c) & ALPHA; }
+bool is_digit(char c) { return char_class(c) & DIGIT; }
+bool is_alnum(char c) { return char_class(c) & (ALPHA | DIGIT); }
+
+// # Chunk Classification
+
+// Bit i of a mask is set iff `chars[i]` is in the class:
+using Mask = std::uint32_t;
+
+static constexpr Mask FULL_MASK = CHUNK_SIZE == 32 ? ~Mask(0) : (Mask(1) << CHUNK_SIZE) - 1;
+
+#if defined(__AVX2__)
+
+using Chunk = __m256i;
+
+static inline Chunk load(const char* chars) { return _mm256_loadu_si256(reinterpret_cast<const Chunk*>(chars)); }
+
+static inline Mask to_mask(Chunk bytes) { return static_cast<Mask>(_mm256_movemask_epi8(bytes)); }
+
+static inline Chunk eq(Chunk chunk, char c) { return _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(c)); }
+
+static inline Chunk or_(Chunk a, Chunk b) { return _mm256_or_si256(a, b); }
+
+// Signed comparisons, so bytes >= 0x80 are never in range:
+static inline Chunk in_range(Chunk chunk, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(chunk, _mm256_set1_epi8(lo - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), chunk));
+}
+
+static inline Chunk lowercase(Chunk chunk) { return _mm256_or_si256(chunk, _mm256_set1_epi8(0x20)); }
+
+#elif defined(__SSE2__)
+
+using Chunk = __m128i;
+
+static inline Chunk load(const char* chars) { return _mm_loadu_si128(reinterpret_cast<const Chunk*>(chars)); }
+
+static inline Mask to_mask(Chunk bytes) { return static_cast<Mask>(_mm_movemask_epi8(bytes)); }
+
+static inline Chunk eq(Chunk chunk, char c) { return _mm_cmpeq_epi8(chunk, _mm_set1_epi8(c)); }
+
+static inline Chunk or_(Chunk a, Chunk b) { return _mm_or_si128(a, b); }
+
+// Signed comparisons, so bytes >= 0x80 are never in range:
+static inline Chunk in_range(Chunk chunk, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8(lo - 1)),
+                         _mm_cmpgt_epi8(_mm_set1_epi8(hi + 1), chunk));
+}
+
+static inline Chunk lowercase(Chunk chunk) { return _mm_or_si128(chunk, _mm_set1_epi8(0x20)); }
+
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+static inline Mask digit_mask(const char* chars) { return to_mask(in_range(load(chars), '0', '9')); }
+
+static inline Mask alnum_mask(const char* chars) {
+    Chunk const chunk = load(chars);
+    return to_mask(or_(in_range(chunk, '0', '9'), in_range(lowercase(chunk), 'a', 'z')));
+}
+
+static inline Mask space_mask(const char* chars) {
+    Chunk const chunk = load(chars);
+    return to_mask(or_(eq(chunk, ' '), in_range(chunk, '\t', '\r')));
+}
+
+#else
+
+static inline Mask class_mask(const char* chars, std::uint8_t classes) {
+    Mask mask = 0;
+    for (std::size_t i = 0; i < CHUNK_SIZE; ++i) {
+        mask |= Mask((char_class(chars[i]) & classes) != 0) << i;
+    }
+    return mask;
+}
+
+static inline Mask digit_mask(const char* chars) { return class_mask(chars, DIGIT); }
+
+static inline Mask alnum_mask(const char* chars) { return class_mask(chars, ALPHA | DIGIT); }
+
+static inline Mask space_mask(const char* chars) { return class_mask(chars, SPACE); }
+
+#endif
+
+// Length of the run of set bits at the bottom of `mask`:
+static inline std::size_t run_length(Mask mask) {
+    Mask const rest = ~mask & FULL_MASK;
+    return rest != 0 ? static_cast<std::size_t>(__builtin_ctz(rest)) : CHUNK_SIZE;
+}
+
+// # Scanners
+
+std::size_t alnums(const char* chars) {
+    std::size_t size = 0;
+    while (true) {
+        std::size_t const run = run_length(alnum_mask(chars + size));
+        size += run;
+        if (run < CHUNK_SIZE) { return size; }
+    }
+}
+
+std::size_t hashed_alnums(const char* chars, std::uint64_t& hash) {
+    std::uint64_t state = HASH_SEED;
+    std::size_t size = 0;
+    while (true) {
+        std::size_t const run = run_length(alnum_mask(chars + size));
+
+        // `CHUNK_SIZE` is a multiple of 8 so this hashes the same words as `hash_chars` would:
+        for (std::size_t i = 0; i < run; i += 8) {
+            state = hash_word(state, load_padded_hash_word(chars + size + i, std::min<std::size_t>(8, run - i)));
+        }
+
+        size += run;
+        if (run < CHUNK_SIZE) {
+            hash = hash_finish(state, size);
+            return size;
+        }
+    }
+}
+
+std::size_t digits(const char* chars) {
+    std::size_t size = 0;
+    while (true) {
+        std::size_t const run = run_length(digit_mask(chars + size));
+        size += run;
+        if (run < CHUNK_SIZE) { return size; }
+    }
+}
+
+const char* spaces(const char* chars) {
+    while (true) {
+        std::size_t const run = run_length(space_mask(chars));
+        chars += run;
+        if (run < CHUNK_SIZE) { return chars; }
+    }
+}
+
+} // namespace brmh::scan
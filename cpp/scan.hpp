@@ -0,0 +1,40 @@
+#ifndef BRMH_SCAN_HPP
+#define BRMH_SCAN_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace brmh::scan {
+
+// Character run scanners for the lexer. These classify a whole vector register worth of bytes at a time (with
+// AVX2 or SSE2 when available) and may thus read up to `CHUNK_SIZE - 1` bytes past the end of the run. That is
+// fine on source code from `Src`, which is always followed by `Src::PADDING` NUL bytes.
+
+#if defined(__AVX2__)
+static constexpr std::size_t CHUNK_SIZE = 32;
+#elif defined(__SSE2__)
+static constexpr std::size_t CHUNK_SIZE = 16;
+#else
+static constexpr std::size_t CHUNK_SIZE = 8;
+#endif
+
+bool is_space(char c);
+bool is_alpha(char c);
+bool is_digit(char c);
+bool is_alnum(char c);
+
+// Length of the run of ASCII letters and digits at `chars`.
+std::size_t alnums(const char* chars);
+
+// Like `alnums` but also computes the `hash_chars` of the run on the way.
+std::size_t hashed_alnums(const char* chars, std::uint64_t& hash);
+
+// Length of the run of ASCII digits at `chars`.
+std::size_t digits(const char* chars);
+
+// Skip the run of whitespace at `chars`.
+const char* spaces(const char* chars);
+
+} // namespace brmh::scan
+
+#endif // BRMH_SCAN_HPP
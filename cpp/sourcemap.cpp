@@ -0,0 +1,37 @@
+#include "sourcemap.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace brmh {
+
+FileId SourceMap::add(Src&& src) {
+    FileId const file = static_cast<FileId>(files_.size());
+    files_.emplace_back(std::move(src));
+    return file;
+}
+
+Src const& SourceMap::src(FileId file) const { return files_[file].src; }
+
+Filename SourceMap::filename(FileId file) const { return files_[file].src.filename(); }
+
+SourceMap::LineCol SourceMap::line_col(Pos pos) const {
+    File const& file = files_[pos.file];
+    std::vector<std::uint32_t>& line_starts = file.line_starts;
+
+    if (line_starts.empty()) {
+        const char* const chars = file.src.source_code();
+        std::size_t const size = file.src.size();
+
+        line_starts.push_back(0);
+        for (const char* c = chars; (c = static_cast<const char*>(memchr(c, '\n', size - (c - chars)))); ++c) {
+            line_starts.push_back(static_cast<std::uint32_t>(c + 1 - chars));
+        }
+    }
+
+    auto const next_line = std::upper_bound(line_starts.begin(), line_starts.end(), pos.offset);
+    std::size_t const line = next_line - line_starts.begin();
+    return LineCol {.line = line, .column = pos.offset - *(next_line - 1) + 1};
+}
+
+} // namespace brmh
@@ -0,0 +1,44 @@
+#ifndef BRMH_SOURCEMAP_HPP
+#define BRMH_SOURCEMAP_HPP
+
+#include <deque>
+#include <vector>
+
+#include "src.hpp"
+#include "pos.hpp"
+
+namespace brmh {
+
+// Owns the source files of a compilation and maps `Pos`:s back to lines and columns.
+struct SourceMap {
+    struct LineCol {
+        std::size_t line;
+        std::size_t column;
+    };
+
+    SourceMap() = default;
+    SourceMap(const SourceMap&) = delete;
+    SourceMap& operator=(const SourceMap&) = delete;
+
+    FileId add(Src&& src);
+
+    Src const& src(FileId file) const;
+    Filename filename(FileId file) const;
+
+    LineCol line_col(Pos pos) const;
+
+private:
+    struct File {
+        Src src;
+        // Offsets of line starts, built on first `line_col` query since only diagnostics need it:
+        mutable std::vector<std::uint32_t> line_starts;
+
+        explicit File(Src&& src_) : src(std::move(src_)), line_starts() {}
+    };
+
+    std::deque<File> files_; // `deque` so that `Src`:s never move once added
+};
+
+} // namespace brmh
+
+#endif // BRMH_SOURCEMAP_HPP
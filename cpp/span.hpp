@@ -5,15 +5,22 @@
 
 namespace brmh {
 
+// Byte range `[start, end)` of a source file. Kept small since a `Span` is copied into every token and IR node.
 struct Span {
-    Pos start;
-    Pos end;
+    FileId file;
+    std::uint32_t start;
+    std::uint32_t end;
 
-    void print(std::ostream& dest) const {
+    Span(Pos start_, Pos end_) : file(start_.file), start(start_.offset), end(end_.offset) {}
+
+    Pos start_pos() const { return Pos {file, start}; }
+    Pos end_pos() const { return Pos {file, end}; }
+
+    void print(SourceMap const& sources, std::ostream& dest) const {
         dest << '(';
-        start.print(dest);
+        start_pos().print(sources, dest);
         dest << ") - (";
-        end.print(dest);
+        end_pos().print(sources, dest);
         dest << ')';
     }
 };
@@ -1,24 +1,124 @@
 #include "src.hpp"
 
 #include <string>
-#include <iostream>
-#include <fstream>
-#include <sstream>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace brmh {
 
-Src::Src(Filename filename, std::string&& source_code) : filename_(filename), source_code_(source_code) {}
+// # Src::Error
+
+Src::Error::Error(Filename filename_, int errnum_) : BrmhError(), filename(filename_), errnum(errnum_) {}
+
+const char* Src::Error::what() const noexcept { return "SrcError"; }
+
+// # Src
+
+Src::Src(Filename filename, const char* chars, std::size_t size, std::size_t mapping_size)
+    : filename_(filename), chars_(chars), size_(size), mapping_size_(mapping_size), buffer_() {}
+
+Src::Src(Filename filename, std::string&& buffer, std::size_t size)
+    : filename_(filename), chars_(nullptr), size_(size), mapping_size_(0), buffer_(std::move(buffer))
+{
+    chars_ = buffer_.data();
+}
+
+Src::Src(Src&& other)
+    : filename_(other.filename_), chars_(other.chars_), size_(other.size_),
+      mapping_size_(other.mapping_size_), buffer_(std::move(other.buffer_))
+{
+    if (mapping_size_ == 0) {
+        chars_ = buffer_.data(); // Small buffers do not survive the move at the same address
+    }
+
+    other.chars_ = nullptr;
+    other.mapping_size_ = 0;
+}
+
+Src::~Src() {
+    if (mapping_size_ > 0) {
+        munmap(const_cast<char*>(chars_), mapping_size_);
+    }
+}
+
+// Closes a file descriptor on scope exit, so that e.g. `read_fd` throwing does not leak it:
+class FdCloser {
+public:
+    explicit FdCloser(int fd) : fd_(fd) {}
+    FdCloser(FdCloser const&) = delete;
+    FdCloser& operator=(FdCloser const&) = delete;
+    ~FdCloser() { close(fd_); }
+
+private:
+    int fd_;
+};
 
 Src Src::file(char const* filename) {
-    // FIXME: Error handling
-    std::fstream infile(filename, std::ios::in);
-    std::stringstream ss;
-    ss << infile.rdbuf();
-    return Src(Filename("<stdin>"), ss.str());
+    if (strcmp(filename, "-") == 0) {
+        return read_fd(Filename("<stdin>"), STDIN_FILENO);
+    }
+
+    Filename const name(filename);
+
+    int const fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { throw Error(name, errno); }
+    FdCloser const closer(fd);
+
+    struct stat stats;
+    if (fstat(fd, &stats) != 0) { throw Error(name, errno); }
+
+    if (!S_ISREG(stats.st_mode) || stats.st_size == 0) { return read_fd(name, fd); }
+
+    std::size_t const size = static_cast<std::size_t>(stats.st_size);
+    if (size > MAX_SIZE) { throw Error(name, EFBIG); }
+    std::size_t const page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    std::size_t const mapping_size = (size + PADDING + page_size - 1) & ~(page_size - 1);
+
+    // Reserve zero pages for the source and its padding and then map the file over the head of them. The
+    // kernel zero-fills the rest of the last file page and the reserved pages after it provide the remaining
+    // `PADDING`, so the source is always NUL-terminated without being copied:
+    void* const base = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) { return read_fd(name, fd); }
+    if (mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, mapping_size);
+        return read_fd(name, fd);
+    }
+    madvise(base, size, MADV_SEQUENTIAL);
+
+    return Src(name, static_cast<const char*>(base), size, mapping_size);
+}
+
+Src Src::read_fd(Filename filename, int fd) {
+    std::string buffer;
+    std::size_t size = 0;
+
+    while (true) {
+        buffer.resize(size + (1 << 16));
+        ssize_t const count = read(fd, buffer.data() + size, buffer.size() - size);
+        if (count > 0) {
+            size += static_cast<std::size_t>(count);
+            if (size > MAX_SIZE) { throw Error(filename, EFBIG); }
+        } else if (count == 0) {
+            break;
+        } else if (errno != EINTR) {
+            throw Error(filename, errno);
+        }
+    }
+
+    buffer.resize(size);
+    buffer.append(PADDING, '\0');
+    return Src(filename, std::move(buffer), size);
 }
 
 Filename Src::filename() const { return filename_; }
 
-const char* Src::source_code() const { return source_code_.c_str(); }
+const char* Src::source_code() const { return chars_; }
+
+std::size_t Src::size() const { return size_; }
 
 } // namespace brmh
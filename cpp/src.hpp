@@ -1,25 +1,58 @@
 #ifndef BRMH_SRC_HPP
 #define BRMH_SRC_HPP
 
+#include <cstdint>
 #include <string>
 
 #include "filename.hpp"
+#include "error.hpp"
 
 namespace brmh {
 
 struct Src {
+    // At least this many NUL bytes always follow `source_code()`, so the lexer can look ahead (even a whole
+    // vector register at a time) without bounds checks:
+    static constexpr std::size_t PADDING = 64;
+
+    // Spans use 32-bit offsets:
+    static constexpr std::size_t MAX_SIZE = UINT32_MAX;
+
+    class Error : public BrmhError {
+    public:
+        Error(Filename filename, int errnum);
+
+        virtual const char* what() const noexcept override;
+
+        Filename filename;
+        int errnum;
+    };
+
     Src() = delete;
+    Src(const Src&) = delete;
+    Src& operator=(const Src&) = delete;
+    Src& operator=(Src&&) = delete;
+
+    Src(Src&& other);
+    ~Src();
 
+    // Memory-maps regular files. Pipes, ttys etc. (and "-" for stdin) are read into a buffer instead.
     static Src file(const char* filename);
 
     Filename filename() const;
     const char* source_code() const;
+    std::size_t size() const;
 
 private:
-    Src(Filename filename, std::string&& source_code);
+    Src(Filename filename, const char* chars, std::size_t size, std::size_t mapping_size);
+    Src(Filename filename, std::string&& buffer, std::size_t size);
+
+    static Src read_fd(Filename filename, int fd);
 
     Filename filename_;
-    std::string source_code_;
+    const char* chars_;
+    std::size_t size_;
+    std::size_t mapping_size_; // Zero unless `chars_` is mmapped
+    std::string buffer_; // Only used when not mmapped
 };
 
 } // namespace brmh
@@ -1,5 +1,3 @@
-#include <cstring>
-
 #include "fast.hpp"
 #include "cps/cps.hpp"
 
@@ -150,7 +148,7 @@ cps::Expr* fast::EqI64::to_cps(cps::Builder& builder, cps::Fn* fn, ToCpsCont con
 }
 
 cps::Expr* fast::Id::to_cps(cps::Builder& builder, cps::Fn*, ToCpsCont const& k, std::optional<Name>) const {
-    return k(builder, span, builder.id(name));
+    return k(builder, span, builder.id(name, type_args));
 }
 
 cps::Expr* fast::Bool::to_cps(cps::Builder& builder, cps::Fn*, ToCpsCont const& k, std::optional<Name>name_hint) const {
@@ -160,7 +158,7 @@ cps::Expr* fast::Bool::to_cps(cps::Builder& builder, cps::Fn*, ToCpsCont const&
 
 cps::Expr* fast::I64::to_cps(cps::Builder& builder, cps::Fn*, ToCpsCont const& k, std::optional<Name>name_hint) const {
     Name const name = name_hint.has_value() ? *name_hint : builder.names()->fresh();
-    return k(builder, span, builder.const_i64(span, name, type, digits, /* OPTIMIZE: */ strlen(digits)));
+    return k(builder, span, builder.const_i64(span, name, type, value));
 }
 
 void fast::Val::to_cps(cps::Builder& builder, cps::Fn* fn) const {
@@ -168,15 +166,30 @@ void fast::Val::to_cps(cps::Builder& builder, cps::Fn* fn) const {
     val_expr->to_cps(builder, fn, ToCpsNextCont(std::optional(id_pat->name)), id_pat->name);
 }
 
-void fast::FunDef::cps_declare(cps::Builder& builder) const {
+void fast::FunDef::cps_declare(cps::Builder& builder, Generics& generics) const {
     type::FnType* const type = builder.types().fn(domain(), codomain);
-    cps::Return* const ret = builder.return_(builder.names()->fresh());
-    builder.fn(span, name, type, /* FIXME: */ true, ret, nullptr);
+    if (type_params.empty()) {
+        cps::Return* const ret = builder.return_(builder.names()->fresh());
+        builder.fn(span, name, type, /* FIXME: */ true, ret, nullptr);
+    } else {
+        builder.generic(span, name, type, type_params);
+        generics.insert({name, this});
+    }
 }
 
 void fast::FunDef::to_cps(cps::Builder& builder) const {
-    cps::Fn* const fn = builder.get_fn(name);
+    if (!type_params.empty()) { return; } // Only its instances get built
+
+    body_to_cps(builder, builder.get_fn(name));
+}
 
+void fast::FunDef::to_cps(cps::Builder& builder, cps::Builder::Instance const& instance) const {
+    builder.specialize(type_params, instance.type_args);
+    body_to_cps(builder, instance.fn);
+    builder.end_specialization();
+}
+
+void fast::FunDef::body_to_cps(cps::Builder& builder, cps::Fn* fn) const {
     cps::Block* const entry = builder.block(params.size(), nullptr);
     std::size_t i = 0;
     for (Pat* pat : params) {
@@ -192,15 +205,21 @@ void fast::FunDef::to_cps(cps::Builder& builder) const {
 
 cps::Program fast::Program::to_cps(Names& names, type::Types& types) const {
     cps::Builder builder(&names, types);
+    Generics generics;
 
     for (const auto def : defs) {
-        def->cps_declare(builder);
+        def->cps_declare(builder, generics);
     }
 
     for (const auto def : defs) {
         def->to_cps(builder);
     }
 
+    // The instances that the monomorphic functions use, and the ones that those use in turn:
+    while (std::optional<cps::Builder::Instance> const instance = builder.next_instance()) {
+        generics.at(instance->generic)->to_cps(builder, *instance);
+    }
+
     return builder.build();
 }
 
@@ -51,7 +51,7 @@ llvm::Value* cps::Bool::do_to_llvm(ToLLVMCtx& ctx, llvm::IRBuilder<>&) const {
 }
 
 llvm::Value* cps::I64::do_to_llvm(ToLLVMCtx& ctx, llvm::IRBuilder<>&) const {
-    return llvm::ConstantInt::get(type->to_llvm(ctx.llvm_ctx), /* FIXME: do this in typechecking, with range checking: */ atol(digits));
+    return llvm::ConstantInt::get(type->to_llvm(ctx.llvm_ctx), static_cast<std::uint64_t>(value), /* isSigned: */ true);
 }
 
 llvm::Value* cps::Param::do_to_llvm(ToLLVMCtx& ctx, llvm::IRBuilder<>&) const {
@@ -67,7 +67,7 @@ void cps::If::to_llvm(ToLLVMCtx &ctx, llvm::IRBuilder<> &builder, Block const* b
     builder.SetInsertPoint(llvm_block);
     builder.CreateCondBr(llvm_cond, llvm_conseq, llvm_alt);
 
-    ctx.successors_phi_inputs.insert({block, {}});
+    ctx.successors_phi_inputs.insert({block, ArenaVector<llvm::Value*>(ctx.arena)});
 }
 
 class GotoToLLVM : public cps::ContVisitor {
@@ -82,7 +82,7 @@ public:
 
     virtual void visit(cps::Block const* dest) override {
         builder_.CreateBr(ctx_.blocks.at(dest));
-        ctx_.successors_phi_inputs.insert({block_, {res_}});
+        ctx_.successors_phi_inputs.insert({block_, ArenaVector<llvm::Value*>({res_}, ctx_.arena)});
     }
 
     virtual void visit(cps::Return const*) override {
@@ -150,11 +150,7 @@ void cps::Block::llvm_patch_phis(ToLLVMCtx &ctx) const {
 
 void cps::Fn::llvm_declare(Names const& names, llvm::LLVMContext& llvm_ctx, llvm::Module& module, llvm::Function::LinkageTypes linkage) const {
     type::FnType* const cps_type = static_cast<type::FnType*>(type); // HACK: static_cast
-    std::vector<llvm::Type*> llvm_domain(cps_type->domain.size());
-    std::transform(cps_type->domain.begin(), cps_type->domain.end(), llvm_domain.begin(), [&] (type::Type* param_type) {
-        return param_type->to_llvm(llvm_ctx);
-    });
-    llvm::FunctionType* const llvm_type = llvm::FunctionType::get(cps_type->codomain->to_llvm(llvm_ctx), llvm_domain, false);
+    llvm::FunctionType* const llvm_type = cps_type->to_llvm_fn(llvm_ctx);
 
     llvm::Twine llvm_name(name.src_name(names).unwrap_or(""));
     llvm::Function* llvm_fn = llvm::Function::Create(llvm_type, linkage, llvm_name, module);
@@ -166,23 +162,15 @@ void cps::Fn::llvm_declare(Names const& names, llvm::LLVMContext& llvm_ctx, llvm
     }
 }
 
-void cps::Fn::llvm_define(Names const& names, llvm::LLVMContext& llvm_ctx, llvm::Module& module) const {
-    cps::doms::DomTree const doms = cps::doms::DomTree::of(this);
+void cps::Fn::llvm_define(Names const& names, llvm::LLVMContext& llvm_ctx, llvm::Module& module,
+                          BumpArena& arena) const {
+    BumpArena::Mark const mark(arena);
 
-    cps::schedule::Schedule const schedule = cps::schedule::schedule_late(this, doms);
-    std::unordered_map<Block const*, std::vector<Expr const*>> block_exprs;
-    for (auto expr_block : schedule) {
-        Expr const* const expr = expr_block.first;
-        Block const* const block = expr_block.second;
-        auto it = block_exprs.find(block);
-        if (it != block_exprs.end()) {
-            it->second.push_back(expr);
-        } else {
-            block_exprs.insert({block, {expr}});
-        }
-    }
+    cps::doms::DomTree const doms = cps::doms::DomTree::of(this, arena);
+
+    cps::schedule::Schedule block_exprs = cps::schedule::schedule_late(this, doms, arena);
 
-    std::unordered_map<Block const*, std::vector<Block const*>> predecessors;
+    ArenaMap<Block const*, ArenaVector<Block const*>> predecessors(arena);
     doms.pre_visit_blocks([&] (cps::Block const* block) {
         for (Cont const* succ : block->transfer->successors()) {
             succ->as_block().iter([&] (Block const* succ) {
@@ -190,14 +178,14 @@ void cps::Fn::llvm_define(Names const& names, llvm::LLVMContext& llvm_ctx, llvm:
                 if (it != predecessors.end()) {
                     it->second.push_back(block);
                 } else {
-                    predecessors.insert({succ, {block}});
+                    predecessors.insert({succ, ArenaVector<Block const*>({block}, arena)});
                 }
             });
         }
     });
 
     llvm::Function* const llvm_fn = module.getFunction(name.src_name(names).unwrap_or(""));
-    ToLLVMCtx ctx(names, llvm_ctx, module, llvm_fn, std::move(block_exprs), std::move(predecessors));
+    ToLLVMCtx ctx(names, llvm_ctx, module, llvm_fn, arena, std::move(block_exprs), std::move(predecessors));
     llvm::IRBuilder builder(llvm_ctx);
 
     // Push params to `ctx`:
@@ -229,13 +217,14 @@ llvm::Value* cps::Fn::do_to_llvm(ToLLVMCtx &ctx, llvm::IRBuilder<> &) const {
     return ctx.llvm_module.getFunction(name.src_name(ctx.names).unwrap_or(""));
 }
 
-void cps::Program::to_llvm(Names const& names, llvm::LLVMContext& llvm_ctx, llvm::Module& module) const {
+void cps::Program::to_llvm(Names const& names, llvm::LLVMContext& llvm_ctx, llvm::Module& module,
+                           BumpArena& scratch) const {
     for (cps::Fn* const ext_fn : externs) {
         ext_fn->llvm_declare(names, llvm_ctx, module, llvm::Function::ExternalLinkage);
     }
 
     for (cps::Fn* const ext_fn : externs) {
-        ext_fn->llvm_define(names, llvm_ctx, module);
+        ext_fn->llvm_define(names, llvm_ctx, module, scratch);
     }
 }
 
@@ -1,22 +1,93 @@
 #include "type.hpp"
 
+#include <atomic>
+
 #include "llvm/IR/DerivedTypes.h"
 
+#include "hash.hpp"
+
 namespace brmh::type {
 
 // # Type
 
+void Type::generalize(std::uint32_t, std::vector<Uv*>&) {}
+
+Type* Type::instantiate(Types&, std::uint32_t, Substitution&) { return this; }
+
+Type* Type::zonk(Types&) { return this; }
+
+void Type::keep_names(Names::Compaction&) {}
+
 // ## Uv
 
-llvm::Type* Uv::to_llvm(llvm::LLVMContext &llvm_ctx) {
-    Type* self = find();
-    assert(!dynamic_cast<Uv*>(self));
-    return self->to_llvm(llvm_ctx);
+void Uv::generalize(std::uint32_t level, std::vector<Uv*>& params) {
+    // `find` to compress the path, so that instantiating the scheme will not write to it:
+    Type* const found = find();
+    if (found != this) {
+        found->generalize(level, params);
+    } else if (level_ > level && std::find(params.begin(), params.end(), this) == params.end()) {
+        // (Already generic if shared with a function of the same component that got generalized first.)
+        level_ = GENERIC;
+        params.push_back(this);
+    }
+}
+
+Type* Uv::instantiate(Types& types, std::uint32_t level, Substitution& subst) {
+    return parent_.match<Type*>([&] (Type* parent) {
+        return parent->instantiate(types, level, subst);
+    }, [&] () -> Type* {
+        if (level_ != GENERIC) { return this; }
+
+        auto const param = std::find(subst.params.begin(), subst.params.end(), this);
+        if (param != subst.params.end()) { return subst.args[param - subst.params.begin()]; }
+
+        Uv* const arg = types.uv(level);
+        subst.params.push_back(this);
+        subst.args.push_back(arg);
+        return arg;
+    });
+}
+
+// Points `parent_` to the result, so that the types that share this only zonk it once. Generalized schemes are zonked
+// already (see `Types::generalize`), so zonking them again, on any thread, does not write:
+Type* Uv::zonk(Types& types) {
+    return parent_.match<Type*>([&] (Type* parent) {
+        Type* const res = parent->zonk(types);
+        if (res != parent) { parent_ = opt_ptr<Type>::some(res); }
+        return res;
+    }, [&] () -> Type* {
+        return this;
+    });
+}
+
+void Uv::keep_names(Names::Compaction& compaction) {
+    parent_.match<void>([&] (Type* parent) {
+        parent->keep_names(compaction);
+    }, [&] () {
+        compaction.keep(name_);
+    });
+}
+
+// The types of the CPS are zonked, so this `Uv` is unresolved and has no representation:
+llvm::Type* Uv::to_llvm(llvm::LLVMContext&) {
+    assert(false);
+    return nullptr;
 }
 
 // ## FnType
 
-FnType::FnType(std::vector<Type*>&& domain_, Type* codomain_) : domain(domain_), codomain(codomain_) {}
+FnType::FnType(std::span<Type* const> domain_, Type* codomain_, bool interned, std::uint32_t level)
+    : domain(domain_), codomain(codomain_), interned_(interned), visiting_(false), level_(level),
+      adjusted_level_(level), sweep_(0), zonked_(nullptr), llvm_ctx_(nullptr), llvm_type_(nullptr) {}
+
+// Of the `find`:ed parts, for a type whose own one is not known or has become stale:
+static std::uint32_t parts_level(std::span<Type* const> domain, Type* codomain) {
+    std::uint32_t level = codomain->find()->level();
+    for (Type* const dom : domain) {
+        level = std::max(level, dom->find()->level());
+    }
+    return level;
+}
 
 void FnType::print(Names const& names, std::ostream& dest) const {
     dest << "fn (";
@@ -37,12 +108,111 @@ void FnType::print(Names const& names, std::ostream& dest) const {
     codomain->print(names, dest);
 }
 
-llvm::Type *FnType::to_llvm(llvm::LLVMContext &llvm_ctx) {
-    std::vector<llvm::Type*> llvm_domain(domain.size());
-    std::transform(domain.begin(), domain.end(), llvm_domain.begin(), [&] (Type* dom) {
-        return dom->to_llvm(llvm_ctx);
-    });
-    return llvm::FunctionType::get(codomain->to_llvm(llvm_ctx), llvm_domain, false);
+void FnType::generalize(std::uint32_t level, std::vector<Uv*>& params) {
+    // `level_` bounds the levels of the `Uv`:s in this once the deferred adjustments are done:
+    if (interned_ || level_ <= level) { return; }
+
+    for (Type* const dom : domain) {
+        dom->generalize(level, params);
+    }
+
+    codomain->generalize(level, params);
+
+    // Exact, so `instantiate` can tell whether this has generic `Uv`:s:
+    level_ = adjusted_level_ = parts_level(domain, codomain);
+}
+
+// Scratch for the new domain of a function type being rebuilt. Most function types are small, so this only allocates
+// for the others:
+class DomainBuffer {
+public:
+    explicit DomainBuffer(std::size_t arity) : small_(), large_(arity > SMALL_ARITY ? arity : 0), parts_() {
+        parts_ = arity > SMALL_ARITY ? std::span<Type*>(large_) : std::span<Type*>(small_).first(arity);
+    }
+
+    DomainBuffer(DomainBuffer const&) = delete;
+    DomainBuffer& operator=(DomainBuffer const&) = delete;
+
+    Type*& operator[](std::size_t i) { return parts_[i]; }
+    std::span<Type*> parts() const { return parts_; }
+
+private:
+    static constexpr std::size_t SMALL_ARITY = 8;
+
+    std::array<Type*, SMALL_ARITY> small_;
+    std::vector<Type*> large_;
+    std::span<Type*> parts_;
+};
+
+Type* FnType::instantiate(Types& types, std::uint32_t level, Substitution& subst) {
+    if (interned_ || level_ != Uv::GENERIC) { return this; }
+
+    // In the same order as `generalize`:
+    DomainBuffer new_domain(domain.size());
+    bool changed = false;
+    bool ground = true;
+    for (std::size_t i = 0; i < domain.size(); ++i) {
+        new_domain[i] = domain[i]->instantiate(types, level, subst);
+        changed = changed || new_domain[i] != domain[i]->find();
+        ground = ground && new_domain[i]->is_interned();
+    }
+    Type* const new_codomain = codomain->instantiate(types, level, subst);
+    changed = changed || new_codomain != codomain->find();
+    ground = ground && new_codomain->is_interned();
+
+    // Still has free `Uv`:s, so it could not be interned anyway:
+    if (!changed && !ground) { return this; }
+
+    return types.fn(new_domain.parts(), new_codomain);
+}
+
+Type* FnType::zonk(Types& types) {
+    if (interned_) { return this; }
+    if (zonked_) { return zonked_; }
+
+    DomainBuffer new_domain(domain.size());
+    bool changed = false;
+    for (std::size_t i = 0; i < domain.size(); ++i) {
+        new_domain[i] = domain[i]->zonk(types);
+        changed = changed || new_domain[i] != domain[i];
+    }
+    Type* const new_codomain = codomain->zonk(types);
+    changed = changed || new_codomain != codomain;
+
+    if (changed) {
+        FnType* const fn = types.fn(new_domain.parts(), new_codomain);
+        if (!fn->interned_) { fn->zonked_ = fn; } // Made of zonked parts
+        zonked_ = fn;
+    } else {
+        // Some parts are unresolved `Uv`:s (else this would be interned), so this is canonical. Its level may be stale
+        // if they have been generalized since it was made, and `instantiate` needs it exact:
+        level_ = adjusted_level_ = parts_level(domain, codomain);
+        zonked_ = this;
+    }
+    return zonked_;
+}
+
+void FnType::keep_names(Names::Compaction& compaction) {
+    for (Type* const dom : domain) {
+        dom->keep_names(compaction);
+    }
+
+    codomain->keep_names(compaction);
+}
+
+llvm::Type *FnType::to_llvm(llvm::LLVMContext &llvm_ctx) { return to_llvm_fn(llvm_ctx); }
+
+llvm::FunctionType* FnType::to_llvm_fn(llvm::LLVMContext& llvm_ctx) {
+    if (llvm_ctx_ != &llvm_ctx) {
+        std::vector<llvm::Type*> llvm_domain(domain.size());
+        std::transform(domain.begin(), domain.end(), llvm_domain.begin(), [&] (Type* dom) {
+            return dom->to_llvm(llvm_ctx);
+        });
+        llvm_type_ = llvm::FunctionType::get(codomain->to_llvm(llvm_ctx), llvm_domain, false);
+        llvm_ctx_ = &llvm_ctx;
+    }
+
+    return llvm_type_;
 }
 
 // ## Bool
@@ -67,12 +237,130 @@ llvm::Type *I64::to_llvm(llvm::LLVMContext& llvm_ctx) {
 
 // # Types
 
+static std::atomic<std::uint64_t> types_serial = 1;
+
+Types::Types(Names& names)
+    : names_(names), serial_(types_serial.fetch_add(1, std::memory_order_relaxed)), arenas_mutex_(), arenas_(),
+      bool_(new(arena().alloc<Bool>()) Bool()), i64_(new(arena().alloc<I64>()) I64()),
+      fn_shards_(), next_sweep_(1) {}
+
+BumpArena& Types::arena() {
+    struct Cache {
+        std::uint64_t owner; // `serial_` of the `Types` that `arena` is from
+        BumpArena* arena;
+    };
+    static thread_local Cache cache {0, nullptr};
+
+    if (cache.owner != serial_) {
+        std::lock_guard<std::mutex> const lock(arenas_mutex_);
+        cache = Cache {serial_, &arenas_.emplace_back()};
+    }
+
+    return *cache.arena;
+}
+
+BumpArena::Stats Types::arena_stats() const {
+    std::lock_guard<std::mutex> const lock(arenas_mutex_);
+
+    BumpArena::Stats stats {};
+    for (BumpArena const& arena : arenas_) {
+        stats += arena.stats();
+    }
+    return stats;
+}
+
 Bool* Types::get_bool() { return bool_; }
 
 I64* Types::get_i64() { return i64_; }
 
-FnType* Types::fn(std::vector<Type*>&& domain, Type* codomain) {
-    return new FnType(std::move(domain), codomain);  // OPTIMIZE
+bool Types::FnKey::operator==(FnKey const& other) const {
+    return codomain->find() == other.codomain->find()
+        && std::equal(domain.begin(), domain.end(), other.domain.begin(), other.domain.end(),
+                      [] (Type* dom, Type* other_dom) { return dom->find() == other_dom->find(); });
+}
+
+std::size_t Types::FnKey::Hash::operator()(FnKey key) const noexcept {
+    std::uint64_t hash = hash_word(HASH_SEED, reinterpret_cast<std::uintptr_t>(key.codomain->find()));
+    for (Type* const dom : key.domain) {
+        hash = hash_word(hash, reinterpret_cast<std::uintptr_t>(dom->find()));
+    }
+    return hash_finish(hash, key.domain.size());
+}
+
+FnType* Types::fn(std::span<Type* const> domain, Type* codomain) {
+    codomain = codomain->find();
+    bool interned = codomain->is_interned();
+    for (Type* const dom : domain) {
+        interned = interned && dom->find()->is_interned();
+    }
+
+    auto const make = [&] {
+        BumpArena& arena = this->arena();
+        Type** const found_domain = static_cast<Type**>(arena.alloc_array<Type*>(domain.size()));
+        std::transform(domain.begin(), domain.end(), found_domain, [] (Type* dom) { return dom->find(); });
+        std::span<Type* const> const parts(found_domain, domain.size());
+        std::uint32_t const level = interned ? 0 : parts_level(parts, codomain);
+        return new(arena.alloc<FnType>()) FnType(parts, codomain, interned, level);
+    };
+
+    if (!interned) { return make(); }
+
+    // Lookup and insertion under the same lock, so that no two threads create the same type:
+    FnKey const key(domain, codomain);
+    FnShard& shard = fn_shards_[FnKey::Hash()(key) >> (sizeof(std::size_t) * 8 - FN_SHARD_BITS)];
+    std::lock_guard<std::mutex> const lock(shard.mutex);
+    auto const it = shard.fns.find(key);
+    if (it != shard.fns.end()) { return *it; }
+
+    FnType* const fn = make();
+    shard.fns.insert(fn);
+    return fn;
+}
+
+FnType* Types::fresh_fn(std::size_t arity, std::uint32_t level) {
+    BumpArena& arena = this->arena();
+    Type** const domain = static_cast<Type**>(arena.alloc_array<Type*>(arity));
+    for (std::size_t i = 0; i < arity; ++i) {
+        domain[i] = uv(level);
+    }
+    Type* const codomain = uv(level);
+
+    return new(arena.alloc<FnType>()) FnType({domain, arity}, codomain, false, level);
+}
+
+void Types::occurs_check(Deferred& deferred) {
+    if (deferred.bindings.empty()) { return; }
+
+    std::uint32_t const sweep = next_sweep_.fetch_add(1, std::memory_order_relaxed);
+    for (Deferred::Binding const& binding : deferred.bindings) {
+        binding.type->occurs_check(sweep, binding.span);
+    }
+    deferred.bindings.clear();
+}
+
+std::span<Uv* const> Types::generalize(Uv* binder, std::uint32_t level, Deferred& deferred) {
+    // Before anything traverses the types again:
+    occurs_check(deferred);
+
+    // Lower the parts of the function types whose levels unification lowered, which can in turn push more of them:
+    while (!deferred.unadjusted.empty()) {
+        FnType* const fn = deferred.unadjusted.back();
+        deferred.unadjusted.pop_back();
+        fn->adjust_level(deferred);
+    }
+
+    std::vector<Uv*> generics; // Only allocates for polymorphic functions
+    binder->generalize(level, generics);
+
+    // Other threads will instantiate the scheme, so it must not share mutable types with the ones of this thread:
+    Type* const scheme = binder->zonk(*this);
+    if (scheme != binder) { binder->parent_ = opt_ptr<Type>::some(scheme); }
+
+    if (generics.empty()) { return {}; }
+
+    Uv** const params = static_cast<Uv**>(arena().alloc_array<Uv*>(generics.size()));
+    std::copy(generics.begin(), generics.end(), params);
+    return {params, generics.size()};
 }
 
 // # Error
@@ -1,6 +1,14 @@
 #ifndef BRMH_TYPE_HPP
 #define BRMH_TYPE_HPP
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <span>
+#include <unordered_set>
 #include <vector>
 #include <ostream>
 
@@ -8,50 +16,111 @@
 
 #include "span.hpp"
 #include "name.hpp"
+#include "bumparena.hpp"
 #include "error.hpp"
 
 namespace brmh::type {
 
+struct Type;
 struct Uv;
 struct FnType;
 struct Bool;
 struct I64;
 class Types;
 
+// Generic `Uv`:s and what to replace them with, when instantiating a type scheme or specializing a polymorphic function.
+// Searched linearly, since schemes only have a handful of parameters:
+struct Substitution {
+    std::vector<Uv const*> params;
+    std::vector<Type*> args;
+
+    void clear() {
+        params.clear();
+        args.clear();
+    }
+};
+
+// What unification leaves for the next generalization point, so that binding a `Uv` takes constant time instead of a
+// traversal of the type it gets bound to. Each typer thread has its own:
+struct Deferred {
+    // Of a `Uv` to a function type, which may have closed a cycle:
+    struct Binding {
+        FnType* type;
+        Span span;
+    };
+
+    std::vector<FnType*> unadjusted; // Function types whose parts have yet to be lowered to their (lowered) level
+    std::vector<Binding> bindings; // For the occurs check
+};
+
 struct Type {
     virtual Type* find() { return this; }
 
-    void occurs_check(Uv* uv, Span span) const;
-    virtual void occurs_check_children(Uv* uv, Span span) const;
-
-    void unify(Type* other, Span span);
-    virtual void unifyFounds(Type* other, Span span) = 0;
-    virtual void unifyFoundUvs(Uv* other, Span span);
-    virtual void unifyFoundFns(FnType* other, Span span);
-    virtual void unifyFoundBools(Bool* other, Span span);
-    virtual void unifyFoundI64s(I64* other, Span span);
+    // Whether this is the only `Type` with its structure, so that pointer equality is type equality:
+    virtual bool is_interned() const { return false; }
+
+    // Of a `find`:ed type: an upper bound of the levels of the unresolved `Uv`:s in it (0 if there are none). Lowering
+    // it can be deferred, see `FnType`:
+    virtual std::uint32_t level() const { return 0; }
+    virtual void lower_level(std::uint32_t level, Deferred& deferred);
+    // Throws an `OccursError` if this contains itself (in a cycle through bound `Uv`:s). `sweep` identifies the check,
+    // so that the parts that are shared are only checked once:
+    virtual void occurs_check(std::uint32_t sweep, Span span);
+
+    void unify(Type* other, Deferred& deferred, Span span);
+    // Of a `find`:ed callee of a call with `arity` args: the function type to check the args against. That is this
+    // itself if it is one, so only calls of callees whose types are still unknown need fresh `Uv`:s to unify with:
+    virtual FnType* as_callee(Types& types, std::size_t arity, std::uint32_t level, Deferred& deferred, Span span);
+    virtual void unifyFounds(Type* other, Deferred& deferred, Span span) = 0;
+    virtual void unifyFoundUvs(Uv* other, Deferred& deferred, Span span);
+    virtual void unifyFoundFns(FnType* other, Deferred& deferred, Span span);
+    virtual void unifyFoundBools(Bool* other, Deferred& deferred, Span span);
+    virtual void unifyFoundI64s(I64* other, Deferred& deferred, Span span);
+
+    // Marks the unresolved `Uv`:s above `level` as generic and appends the ones not in `params` yet, in the order that
+    // `instantiate` visits them. The `deferred` work must have been done (see `Types::generalize`):
+    virtual void generalize(std::uint32_t level, std::vector<Uv*>& params);
+    // Replaces the generic `Uv`:s with their `subst` args, adding fresh `Uv`:s at `level` for the ones not in it yet.
+    // Types without generic `Uv`:s are returned as is, without a traversal:
+    virtual Type* instantiate(Types& types, std::uint32_t level, Substitution& subst);
+
+    // The canonical form of `this`, without resolved `Uv`:s to `find` through and interned if ground. Inference runs
+    // this on the types it hands to later passes, so that those never need union-find:
+    virtual Type* zonk(Types& types);
 
     virtual void print(Names const& names, std::ostream& dest) const = 0;
 
+    // Keeps the names of the unresolved type variables; resolved ones are never printed, so theirs are left stale:
+    virtual void keep_names(Names::Compaction& compaction);
+
     virtual llvm::Type* to_llvm(llvm::LLVMContext& llvm_ctx) = 0;
 };
 
+// Kept to the vtable pointer and two words, since typechecking creates one for every call site argument and unannotated
+// binder:
 struct Uv :public Type {
+    // Level of the `Uv`:s of a type scheme, which only ever get instantiated:
+    static constexpr std::uint32_t GENERIC = (std::uint32_t(1) << 24) - 1;
+
 private:
     friend class Types;
 
-    Name name_;
     opt_ptr<Type> parent_;
-    std::size_t rank_;
+    Name name_;
+    std::uint32_t rank_ : 8; // At most log2 of the number of `Uv`:s
+    // Generalization level: the `Uv` can be generalized once checking has left it. Unification keeps the lowest level
+    // among the `Uv`:s it joins, so no environment scan is needed to find the ones that are still in use:
+    std::uint32_t level_ : 24;
 
-    Uv(Name name)
-        : Type(), name_(name), parent_(opt_ptr<Type>::none()), rank_(0) {}
+    Uv(Name name, std::uint32_t level)
+        : Type(), parent_(opt_ptr<Type>::none()), name_(name), rank_(0), level_(level) {}
 
 public:
+    // Only writes if that shortens the path, so `find`ing in generalized (and thus compressed) types is a pure read:
     virtual Type* find() override {
         return parent_.match<Type*>([&] (Type* parent) {
             Type* res = parent->find();
-            parent_ = opt_ptr<Type>::some(res);
+            if (res != parent) { parent_ = opt_ptr<Type>::some(res); }
             return res;
         }, [&] () {
             return this;
@@ -63,13 +132,17 @@ public:
         assert(other->parent_.is_none());
         assert(this != other);
 
+        std::uint32_t const level = std::min(level_, other->level_);
         if (rank_ < other->rank_) {
             parent_ = opt_ptr<Type>::some(other);
+            other->level_ = level;
         } else if (rank_ > other->rank_) {
             other->parent_ = opt_ptr<Type>::some(this);
+            level_ = level;
         } else {
             parent_ = opt_ptr<Type>::some(other);
             other->rank_ += 1;
+            other->level_ = level;
         }
     }
 
@@ -79,13 +152,20 @@ public:
         parent_ = opt_ptr<Type>::some(other);
     }
 
-    virtual void occurs_check_children(Uv* uv, Span span) const override;
+    virtual std::uint32_t level() const override { return level_; }
+    virtual void lower_level(std::uint32_t level, Deferred& deferred) override;
+
+    virtual void generalize(std::uint32_t level, std::vector<Uv*>& params) override;
+    virtual Type* instantiate(Types& types, std::uint32_t level, Substitution& subst) override;
+    virtual Type* zonk(Types& types) override;
 
-    virtual void unifyFounds(Type* other, Span span) override { other->unifyFoundUvs(this, span); }
-    virtual void unifyFoundUvs(Uv* other, Span span) override;
-    virtual void unifyFoundFns(FnType* other, Span span) override;
-    virtual void unifyFoundBools(Bool* other, Span span) override;
-    virtual void unifyFoundI64s(I64* other, Span span) override;
+    virtual void unifyFounds(Type* other, Deferred& deferred, Span span) override {
+        other->unifyFoundUvs(this, deferred, span);
+    }
+    virtual void unifyFoundUvs(Uv* other, Deferred& deferred, Span span) override;
+    virtual void unifyFoundFns(FnType* other, Deferred& deferred, Span span) override;
+    virtual void unifyFoundBools(Bool* other, Deferred& deferred, Span span) override;
+    virtual void unifyFoundI64s(I64* other, Deferred& deferred, Span span) override;
 
     virtual void print(Names const& names, std::ostream& dest) const override {
         parent_.match<void>([&] (Type const* parent) {
@@ -96,31 +176,71 @@ public:
         });
     }
 
+    virtual void keep_names(Names::Compaction& compaction) override;
+
     virtual llvm::Type* to_llvm(llvm::LLVMContext& llvm_ctx) override;
 };
 
+// The levels of function types make binding a `Uv` cheap: instead of traversing the type that it gets bound to (for
+// the occurs check and to lower the levels of the `Uv`:s in it, as in Kiselyov's "Efficient and Insightful
+// Generalization"), unification just lowers the `level_` of the type itself. Lowering the levels of its parts is
+// deferred to the next generalization point, which also checks the types bound since the last one for cycles in a
+// single sweep. Unification itself only has to notice when it runs into a cycle.
 struct FnType : public Type {
-    virtual void occurs_check_children(Uv* uv, Span span) const override;
-
-    virtual void unifyFounds(Type* other, Span span) override { other->unifyFoundFns(this, span); }
-    virtual void unifyFoundFns(FnType* other, Span span) override;
+    virtual bool is_interned() const override { return interned_; }
+
+    virtual std::uint32_t level() const override { return interned_ ? 0 : level_; }
+    virtual void lower_level(std::uint32_t level, Deferred& deferred) override;
+    // Lowers the parts to `level_`, if that has been deferred:
+    void adjust_level(Deferred& deferred);
+    virtual void occurs_check(std::uint32_t sweep, Span span) override;
+
+    virtual void generalize(std::uint32_t level, std::vector<Uv*>& params) override;
+    virtual Type* instantiate(Types& types, std::uint32_t level, Substitution& subst) override;
+    virtual Type* zonk(Types& types) override;
+
+    virtual FnType* as_callee(Types& types, std::size_t arity, std::uint32_t level, Deferred& deferred,
+                              Span span) override;
+    virtual void unifyFounds(Type* other, Deferred& deferred, Span span) override {
+        other->unifyFoundFns(this, deferred, span);
+    }
+    virtual void unifyFoundUvs(Uv* other, Deferred& deferred, Span span) override;
+    virtual void unifyFoundFns(FnType* other, Deferred& deferred, Span span) override;
 
     virtual void print(Names const& names, std::ostream& dest) const override;
 
+    virtual void keep_names(Names::Compaction& compaction) override;
+
     virtual llvm::Type* to_llvm(llvm::LLVMContext& llvm_ctx) override;
+    // Cached, so interned function types are only lowered once per context:
+    llvm::FunctionType* to_llvm_fn(llvm::LLVMContext& llvm_ctx);
 
-    std::vector<Type*> domain;
+    std::span<Type* const> domain; // In the arena of the `Types`
     Type* codomain;
 
 private:
     friend class Types;
 
-    FnType(std::vector<Type*>&& domain, Type* codomain);
+    FnType(std::span<Type* const> domain, Type* codomain, bool interned, std::uint32_t level);
+
+    bool interned_;
+    bool visiting_; // On the path of a traversal that would not terminate on a cycle (unification or `occurs_check`)
+    std::uint32_t level_; // `Uv::GENERIC` if this has generic `Uv`:s
+    std::uint32_t adjusted_level_; // That of the parts; above `level_` while this is in `Deferred::unadjusted`
+    std::uint32_t sweep_; // Of the last `occurs_check` that got through this
+    // Result of `zonk`, which is only called once inference is done with this, or nullptr:
+    Type* zonked_;
+    llvm::LLVMContext* llvm_ctx_;
+    llvm::FunctionType* llvm_type_;
 };
 
 struct Bool : public Type {
-    virtual void unifyFounds(Type* other, Span span) override { other->unifyFoundBools(this, span); }
-    virtual void unifyFoundBools(Bool* other, Span span) override;
+    virtual bool is_interned() const override { return true; }
+
+    virtual void unifyFounds(Type* other, Deferred& deferred, Span span) override {
+        other->unifyFoundBools(this, deferred, span);
+    }
+    virtual void unifyFoundBools(Bool* other, Deferred& deferred, Span span) override;
 
     virtual void print(Names const& names, std::ostream& dest) const override;
 
@@ -133,8 +253,12 @@ private:
 };
 
 struct I64 : public Type {
-    virtual void unifyFounds(Type* other, Span span) override { other->unifyFoundI64s(this, span); }
-    virtual void unifyFoundI64s(I64* other, Span span) override;
+    virtual bool is_interned() const override { return true; }
+
+    virtual void unifyFounds(Type* other, Deferred& deferred, Span span) override {
+        other->unifyFoundI64s(this, deferred, span);
+    }
+    virtual void unifyFoundI64s(I64* other, Deferred& deferred, Span span) override;
 
     virtual void print(Names const& names, std::ostream& dest) const override;
 
@@ -147,17 +271,80 @@ private:
 };
 
 class Types {
+    // Structure of a `FnType` whose parts are interned, so comparing the part pointers suffices. The parts of a lookup
+    // key are `find`:ed on the fly, so that it can use the domain as given:
+    struct FnKey {
+        std::span<Type* const> domain;
+        Type* codomain;
+
+        FnKey(std::span<Type* const> domain_, Type* codomain_) : domain(domain_), codomain(codomain_) {}
+        FnKey(FnType const* fn) : domain(fn->domain), codomain(fn->codomain) {}
+
+        bool operator==(FnKey const& other) const;
+
+        // Transparent, so that lookups do not need to allocate a `FnType`:
+
+        struct Hash {
+            using is_transparent = void;
+
+            std::size_t operator()(FnKey key) const noexcept;
+        };
+
+        struct Eq {
+            using is_transparent = void;
+
+            bool operator()(FnKey key, FnKey other) const { return key == other; }
+        };
+    };
+
+    // Interned function types, split like the identifier tables of `Names` so that threads only contend when they
+    // intern similar types at the same time:
+    struct alignas(64) FnShard {
+        std::mutex mutex;
+        std::unordered_set<FnType*, FnKey::Hash, FnKey::Eq> fns;
+    };
+
+    static constexpr std::size_t FN_SHARD_BITS = 4;
+    static constexpr std::size_t FN_SHARD_COUNT = 1 << FN_SHARD_BITS;
+
+    // Every `Type` and `FnType` domain is in one of these; they are all freed with the `Types`. Each thread allocates
+    // in its own, found through a thread-local cache like the fresh id blocks of `Names`:
+    BumpArena& arena();
+
     Names& names_;
+    std::uint64_t serial_; // Tells apart instances, for the thread-local arena cache
+    mutable std::mutex arenas_mutex_;
+    std::deque<BumpArena> arenas_; // Never move, so the cache can point into them
     Bool* bool_;
     I64* i64_;
+    std::array<FnShard, FN_SHARD_COUNT> fn_shards_;
+    std::atomic<std::uint32_t> next_sweep_; // For `FnType::occurs_check`
 
 public:
-    Types(Names& names) : names_(names), bool_(new Bool()), i64_(new I64()) {}
-
-    Uv* uv() { return new Uv(names_.fresh()); }
-    FnType* fn(std::vector<Type*>&& domain, Type* codomain);
+    // Thread-safe, so that independent definitions can be checked in parallel:
+    Types(Names& names);
+
+    Types(Types const&) = delete;
+    Types& operator=(Types const&) = delete;
+
+    Uv* uv(std::uint32_t level) { return new(arena().alloc<Uv>()) Uv(names_.fresh(), level); }
+    // Interned if the (`find`:ed) domain and codomain are. Types with `Uv`:s are not, since unification can still
+    // change them. The domain is copied, so it can be scratch data of the caller:
+    FnType* fn(std::span<Type* const> domain, Type* codomain);
+    // `fn (^a1, ..., ^an) -> ^b` with fresh `Uv`:s, for the callee of a call:
+    FnType* fresh_fn(std::size_t arity, std::uint32_t level);
+    // Checks the types bound since the last check for cycles and throws an `OccursError` at the earliest binding that
+    // reaches one, which need not be the one that closed it:
+    void occurs_check(Deferred& deferred);
+    // Does the `deferred` work, then turns the type of `binder` into a type scheme (see `Type::generalize`) and returns
+    // its parameters. `binder` gets bound to the zonked scheme, which is only read afterwards, so other threads can
+    // instantiate it:
+    std::span<Uv* const> generalize(Uv* binder, std::uint32_t level, Deferred& deferred);
     Bool* get_bool();
     I64* get_i64();
+
+    // Of all the arenas:
+    BumpArena::Stats arena_stats() const;
 };
 
 // # Errors
@@ -180,6 +367,14 @@ public:
     virtual const char* what() const noexcept override { return "UnboundError"; }
 };
 
+// Of a global name that an earlier def (maybe in another file) already bound:
+class RedefinitionError : public Error {
+public:
+    explicit RedefinitionError(Span span) : Error(span) {}
+
+    virtual const char* what() const noexcept override { return "RedefinitionError"; }
+};
+
 class UnificationError : public Error {
 public:
     Type const* left;
@@ -191,13 +386,12 @@ public:
     virtual const char* what() const noexcept override { return "UnificationError"; }
 };
 
+// Found lazily, so `span` is that of a unification that closed or ran into the cycle:
 class OccursError : public Error {
 public:
-    Uv const* uv;
-    Type const* type;
+    Type const* type; // Contains itself
 
-    OccursError(Span span, Uv const* uv_, Type const* type_)
-        : Error(span), uv(uv_), type(type_) {}
+    OccursError(Span span, Type const* type_) : Error(span), type(type_) {}
 
     virtual const char* what() const noexcept override { return "OccursError"; }
 };
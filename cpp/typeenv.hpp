@@ -1,46 +1,112 @@
 #ifndef BRMH_TYPEENV_HPP
 #define BRMH_TYPEENV_HPP
 
+#include <cstdint>
 #include <optional>
+#include <unordered_map>
+#include <vector>
 
 #include "type.hpp"
 #include "fast.hpp"
 
 namespace brmh {
 
+// Scoped symbol table: a single hash table maps each source name to its innermost binding, and an undo log of the
+// bindings in scope records which binding each one shadows. Lookups are O(1) however many scopes enclose them (the
+// typer opens one for every `val`), and popping a scope only costs as much as the bindings it made.
+//
+// The global definitions are bound in one `TypeEnv` that each thread of the typer then extends with a `TypeEnv` of
+// its own, so that they do not need to copy or lock it.
 class TypeEnv {
+    static constexpr std::uint32_t NONE = UINT32_MAX;
+
+    struct Binding {
+        Name name;
+        Name unique_name;
+        type::Type* type;
+        std::uint32_t shadowed; // Index of the previous binding of `name` in `bindings_`, or `NONE`
+    };
+
     Names& names_;
     type::Types& types_;
-    std::unordered_map<Name, std::pair<Name, type::Type*>, Name::Hash> bindings_;
-    std::optional<TypeEnv*> parent_;
-
-    TypeEnv(Names& names, type::Types& types, TypeEnv* parent)
-        : names_(names), types_(types), bindings_(), parent_(parent) {}
+    TypeEnv const* globals_; // Searched if a name is not bound here, or nullptr
+    // Indices into `bindings_`, or `NONE` once a name goes out of scope. Entries are never erased, so rebinding a name
+    // does not allocate:
+    std::unordered_map<Name, std::uint32_t, Name::Hash> innermost_;
+    std::vector<Binding> bindings_; // Innermost last
+    std::vector<std::size_t> scopes_; // Sizes of `bindings_` when the open scopes were pushed
+    std::uint32_t level_; // Generalization level of new `Uv`:s
+    type::Deferred deferred_; // Of the unifications in this environment
 
 public:
     TypeEnv(Names& names, type::Types& types)
-        : names_(names), types_(types), bindings_(), parent_() {}
+        : names_(names), types_(types), globals_(nullptr), innermost_(), bindings_(), scopes_(), level_(0),
+          deferred_() {}
+
+    // Starts out with the bindings (and level) of `globals`, which must not change while this is in use:
+    explicit TypeEnv(TypeEnv const* globals)
+        : names_(globals->names_), types_(globals->types_), globals_(globals),
+          innermost_(), bindings_(), scopes_(), level_(globals->level_), deferred_() {}
+
+    TypeEnv(TypeEnv const&) = delete;
+
+    TypeEnv& operator=(TypeEnv const&) = delete;
 
     type::Types& types() const { return types_; }
 
+    type::Deferred& deferred() { return deferred_; }
+
     std::optional<std::pair<Name, type::Type*>> find(Name name) const {
-        auto it = bindings_.find(name);
-        return it != bindings_.end()
-                ? it->second
-                : parent_
-                  ? parent_.value()->find(name)
-                  : std::optional<std::pair<Name, type::Type*>>();
+        auto const it = innermost_.find(name);
+        if (it == innermost_.end() || it->second == NONE) {
+            return globals_ ? globals_->find(name) : std::optional<std::pair<Name, type::Type*>>();
+        }
+
+        Binding const& binding = bindings_[it->second];
+        return std::pair {binding.unique_name, binding.type};
     }
 
-    TypeEnv push_frame() { return TypeEnv(names_, types_, this); }
+    void push_scope() { scopes_.push_back(bindings_.size()); }
+
+    void pop_scope() {
+        std::size_t const start = scopes_.back();
+        scopes_.pop_back();
 
+        while (bindings_.size() > start) {
+            Binding const& binding = bindings_.back();
+            innermost_[binding.name] = binding.shadowed;
+            bindings_.pop_back();
+        }
+    }
+
+    // Number of open scopes, to `pop_scopes` back to:
+    std::size_t depth() const { return scopes_.size(); }
+
+    void pop_scopes(std::size_t depth) {
+        while (scopes_.size() > depth) { pop_scope(); }
+    }
+
+    // Within a scope the first binding of a name wins, as with the per-scope maps that this replaced:
     Name declare(Name name, type::Type* type) {
         Name const unique_name = names_.freshen(name);
-        bindings_.insert({name, {unique_name, type}});
+
+        std::uint32_t& innermost = innermost_.try_emplace(name, NONE).first->second;
+        std::size_t const scope_start = scopes_.empty() ? 0 : scopes_.back();
+        if (innermost == NONE || innermost < scope_start) {
+            std::uint32_t const index = static_cast<std::uint32_t>(bindings_.size());
+            bindings_.push_back(Binding {name, unique_name, type, innermost});
+            innermost = index;
+        }
+
         return unique_name;
     }
 
-    type::Uv* uv() const { return types_.uv(); }
+    // The `Uv`:s created between these can be generalized after `leave_level`, unless unification has lowered theirs:
+    void enter_level() { ++level_; }
+    void leave_level() { --level_; }
+    std::uint32_t level() const { return level_; }
+
+    type::Uv* uv() const { return types_.uv(level_); }
 };
 
 } // namespace brmh
@@ -1,24 +1,159 @@
-#include <cstring>
+#include <atomic>
+#include <optional>
+#include <vector>
 
 #include "type.hpp"
 #include "ast.hpp"
 #include "typeenv.hpp"
 #include "fast.hpp"
+#include "parallel.hpp"
 
 namespace brmh {
 
+// # Typing State
+
+// Explicit stack for `type_of`, so that nesting depth and block length are only limited by heap memory. Shared by
+// all the components that a thread of `Program::check` checks, so that its buffers get reused:
+struct ast::Program::Typing {
+    // Unfinished node enclosing the expression being typed:
+    struct Frame {
+        Expr expr;
+        std::size_t child; // Index of the child being typed
+        std::size_t base; // BLOCK: `TypeEnv::depth` on entry, others: size of `exprs`
+        std::span<fast::Stmt*> typed_stmts; // BLOCK
+        type::FnType* callee_type; // CALL
+        std::span<fast::Expr*> typed_args; // CALL
+    };
+
+    std::vector<Frame> frames;
+    std::vector<fast::Expr*> exprs; // Typed children of IF, CALL and PRIM_APP frames, as their later ones are typed
+    type::Substitution subst; // Scratch for instantiating the types of IDs
+
+    // Enter the scope of the statement `frame.child` of a block (or its body, after the last one) and return the
+    // expression to type there:
+    Expr block_child(Program const& ast, TypeEnv& env, Frame& frame) {
+        Block const& block = ast.blocks[frame.expr.index()];
+        std::span<Stmt const> const block_stmts = ast.stmts(block.stmts);
+
+        if (frame.child < block_stmts.size()) {
+            Stmt const stmt = block_stmts[frame.child];
+            switch (stmt.tag()) {
+            case StmtTag::VAL: {
+                env.push_scope();
+                return ast.vals[stmt.index()].val_expr;
+            }
+
+            case StmtTag::COUNT: break;
+            }
+            assert(false); // unreachable
+        }
+
+        return block.body;
+    }
+};
+
 // # Program
 
-fast::Program ast::Program::check(Names& names, type::Types& types) {
-    fast::Program program;
-    TypeEnv env(names, types);
+fast::Program ast::Program::check(Names& names, type::Types& types, std::size_t jobs) const {
+    TypeEnv globals(names, types);
+
+    // The `Uv`:s of the defs are above the top level, so that generalization picks up the ones left unconstrained:
+    globals.enter_level();
 
     for (auto def : defs) {
-        def->declare(env);
+        declare(globals, def);
     }
 
-    for (auto def : defs) {
-       program.push_toplevel(def->check(program, env));
+    // Callees get checked and generalized before their callers instantiate them, so a component only waits for the
+    // ones it refers to. The defs of a component use each other monomorphically.
+    //
+    // Components are claimed in order, so with one thread they are checked in order, and a claimed component only
+    // waits for earlier ones, which have been claimed already (so it does not deadlock).
+    enum struct State : std::uint8_t { PENDING, DONE, FAILED };
+
+    struct Worker {
+        fast::Program program;
+        TypeEnv env;
+        Typing typing;
+
+        explicit Worker(TypeEnv const* globals) : program(), env(globals), typing() {}
+    };
+
+    DefComponents const components = def_components();
+    std::size_t const component_count = components.components.size();
+    std::vector<std::atomic<State>> states(component_count);
+    // An error skips the components after it, but the earlier ones still get checked, as without threads (so that the
+    // same error gets reported). That also means that a worker whose `env` an error left in disarray never checks
+    // again:
+    std::atomic<std::size_t> first_error = component_count;
+    std::vector<fast::Def*> typed_defs(defs.size());
+    std::vector<std::optional<Worker>> workers(worker_count(component_count, jobs));
+    // The fresh names of each component get numbered in component order at the end, so the output is the same
+    // whichever threads checked which components:
+    std::vector<Names::Unit> units(component_count, Names::Unit(names));
+
+    parallel_for_workers(component_count, jobs, [&] (std::size_t worker_index, std::size_t i) {
+        DefComponents::Component const component = components.components[i];
+        std::span<std::uint32_t const> const members(components.defs.data() + component.defs.start,
+                                                     component.defs.count);
+        std::span<std::uint32_t const> const callees(components.callees.data() + component.callees.start,
+                                                     component.callees.count);
+
+        State state = i < first_error.load(std::memory_order_relaxed) ? State::DONE : State::FAILED;
+        for (std::uint32_t const callee : callees) {
+            if (state != State::DONE) { break; }
+
+            states[callee].wait(State::PENDING, std::memory_order_acquire);
+            state = states[callee].load(std::memory_order_acquire);
+        }
+
+        if (state == State::DONE) {
+            std::optional<Worker>& worker = workers[worker_index];
+            if (!worker) { worker.emplace(&globals); }
+            Names::UnitScope const unit_scope(units[i]);
+
+            try {
+                try {
+                    for (std::uint32_t const def : members) {
+                        typed_defs[def] = check(worker->program, worker->typing, worker->env, defs[def]);
+                    }
+                } catch (type::Error const&) {
+                    // A cycle that was closed before this error would have been reported instead, had the occurs
+                    // check not been deferred:
+                    types.occurs_check(worker->env.deferred());
+                    throw;
+                }
+
+                for (std::uint32_t const def : members) {
+                    generalize(worker->env, defs[def], typed_defs[def]);
+                }
+
+                // Later components only instantiate the types of this one, so they are final:
+                worker->program.zonk(types);
+            } catch (...) {
+                std::size_t error = first_error.load(std::memory_order_relaxed);
+                while (i < error && !first_error.compare_exchange_weak(error, i, std::memory_order_relaxed)) {}
+
+                states[i].store(State::FAILED, std::memory_order_release);
+                states[i].notify_all();
+                throw;
+            }
+        }
+
+        states[i].store(state, std::memory_order_release);
+        states[i].notify_all();
+    });
+
+    for (Names::Unit& unit : units) {
+        names.number(unit);
+    }
+
+    fast::Program program;
+    for (std::optional<Worker>& worker : workers) {
+        if (worker) { program.absorb(std::move(worker->program)); }
+    }
+    for (fast::Def* const typed_def : typed_defs) {
+        program.push_toplevel(typed_def);
     }
 
     return program;
@@ -26,259 +161,440 @@ fast::Program ast::Program::check(Names& names, type::Types& types) {
 
 // # Defs
 
-void ast::FunDef::declare(TypeEnv &env) {
-    env.declare(name, env.uv());
-}
+void ast::Program::declare(TypeEnv& env, Def def) const {
+    switch (def.tag()) {
+    case DefTag::FUN: {
+        FunDef const& fun_def = fun_defs[def.index()];
 
-fast::Def* ast::FunDef::check(fast::Program& program, TypeEnv& parent_env) {
-    auto const binding = parent_env.find(name).value();
-    Name const unique_name = binding.first;
-
-    TypeEnv env = parent_env.push_frame();
-    std::vector<fast::Pat*> new_params;
-    std::vector<type::Type*> domain;
-    for (Pat const* param : params) {
-        fast::Pat* const new_param = param->type_of(program, env);
-        new_params.push_back(new_param);
-        domain.push_back(new_param->type);
+        // `declare` would keep the first binding, and both defs would then get its unique name:
+        if (env.find(fun_def.name)) { throw type::RedefinitionError(fun_def.span); }
+
+        env.declare(fun_def.name, env.uv());
+        break;
     }
 
-    fast::Expr* typed_body = body->check(program, env, codomain);
+    case DefTag::COUNT: assert(false); // unreachable
+    }
+}
 
-    binding.second->unify(env.types().fn(std::move(domain), codomain), span);
+fast::Def* ast::Program::check(fast::Program& program, Typing& typing, TypeEnv& env, Def def) const {
+    switch (def.tag()) {
+    case DefTag::FUN: {
+        FunDef const& fun_def = fun_defs[def.index()];
+
+        auto const binding = env.find(fun_def.name).value();
+        Name const unique_name = binding.first;
+
+        env.push_scope();
+        std::vector<fast::Pat*> new_params;
+        std::vector<type::Type*> domain;
+        for (Pat const param : pats(fun_def.params)) {
+            fast::Pat* const new_param = type_of(program, env, param);
+            new_params.push_back(new_param);
+            domain.push_back(new_param->type);
+        }
 
-    return program.fun_def(span, unique_name, std::move(new_params), codomain, typed_body);
-}
+        fast::Expr* typed_body = check(program, typing, env, fun_def.body, fun_def.codomain);
 
-// # Expressions
+        binding.second->unify(env.types().fn(domain, fun_def.codomain), env.deferred(), fun_def.span);
+        env.pop_scope();
 
-fast::Expr* type_block(fast::Program& program, TypeEnv& env,
-                       std::vector<ast::Stmt*> const& stmts, std::size_t i,
-                       ast::Expr const* body,
-                       std::span<fast::Stmt*> typed_stmts)
-{
-    if (i < stmts.size()) {
-        auto stmt_env = stmts[i]->check(program, env);
-        typed_stmts[i] = stmt_env.first;
-        return type_block(program, stmt_env.second, stmts, i + 1, body, typed_stmts);
-    } else {
-        return body->type_of(program, env);
+        return program.fun_def(fun_def.span, unique_name, std::move(new_params), fun_def.codomain, typed_body);
     }
-}
 
-fast::Expr* ast::Block::type_of(fast::Program& program, TypeEnv& env) const {
-    if (stmts.size() > 0) {
-        std::span<fast::Stmt*> typed_stmts = program.stmts(stmts.size());
-        auto typed_body = type_block(program, env, stmts, 0, body, typed_stmts);
-        return program.block(span, typed_body->type, std::move(typed_stmts), typed_body);
-    } else {
-        return body->type_of(program, env);
+    case DefTag::COUNT: break;
     }
+    assert(false); // unreachable
 }
 
-fast::Expr* ast::If::type_of(fast::Program& program, TypeEnv& env) const {
-    fast::Expr* const typed_cond = cond->check(program, env, env.types().get_bool());
-    fast::Expr* const typed_conseq = conseq->type_of(program, env);
-    type::Type* const type = typed_conseq->type;
-    fast::Expr* const typed_alt = alt->check(program, env, type); // TODO: treat branch types equally
-    return program.if_(span, type, typed_cond, typed_conseq, typed_alt);
+void ast::Program::generalize(TypeEnv& env, Def def, fast::Def* typed_def) const {
+    switch (def.tag()) {
+    case DefTag::FUN: {
+        // HACK: static_casts (the binding is the `Uv` from `declare`):
+        auto const binder = static_cast<type::Uv*>(env.find(fun_defs[def.index()].name).value().second);
+        static_cast<fast::FunDef*>(typed_def)->type_params
+            = env.types().generalize(binder, env.level() - 1, env.deferred());
+        break;
+    }
+
+    case DefTag::COUNT: assert(false); // unreachable
+    }
 }
 
-fast::Expr* ast::Call::type_of(fast::Program &program, TypeEnv &env) const {
-    std::size_t arity = args.size();
+// # Expressions
 
-    std::vector<type::Type*> domain;
-    domain.reserve(arity);
-    for (std::size_t i = 0; i < args.size(); ++i) {
-        domain.push_back(env.uv());
-    }
-    auto const codomain = env.uv();
-    auto const callee_type = env.types().fn(std::move(domain), codomain);
+fast::Expr* ast::Program::type_of(fast::Program& program, Typing& typing, TypeEnv& env, Expr expr) const {
+    std::size_t const floor = typing.frames.size();
 
-    fast::Expr* const typed_callee = callee->check(program, env, callee_type);
+    fast::Expr* typed_expr = descend(program, typing, env, expr);
+    while (typing.frames.size() > floor) {
+        Typing::Frame& frame = typing.frames.back();
+        std::size_t const child = frame.child++;
 
-    std::span<fast::Expr*> typed_args = program.args(arity);
-    for (std::size_t i = 0; i < arity; ++i) {
-        typed_args[i] = args[i]->check(program, env, callee_type->domain[i]);
-    }
+        switch (frame.expr.tag()) {
+        case ExprTag::BLOCK: {
+            Block const& block = blocks[frame.expr.index()];
+            std::span<Stmt const> const block_stmts = stmts(block.stmts);
 
-    return program.call(span, codomain, typed_callee, typed_args);
-}
+            if (child < block_stmts.size()) {
+                Stmt const stmt = block_stmts[child];
+                switch (stmt.tag()) {
+                case StmtTag::VAL: {
+                    Val const& val = vals[stmt.index()];
 
-fast::Expr* ast::PrimApp::type_of(fast::Program& program, TypeEnv& env) const {
-    switch (op) {
-    case ast::PrimApp::Op::ADD_W_I64:
-    case ast::PrimApp::Op::SUB_W_I64:
-    case ast::PrimApp::Op::MUL_W_I64: {
-        // FIXME: Brittle '2':s:
-        if (args.size() != 2) { throw type::PrimArgcError(span, 2, args.size()); }
+                    auto const typed_pat = check(program, env, val.pat, typed_expr->type);
+                    frame.typed_stmts[child] = program.val(val.span, typed_pat, typed_expr);
+                    break;
+                }
 
-        std::array<fast::Expr*, 2> typed_args;
+                case StmtTag::COUNT: assert(false); // unreachable
+                }
+
+                Expr const next = typing.block_child(*this, env, frame);
+                typed_expr = descend(program, typing, env, next);
+            } else {
+                typed_expr = program.block(block.span, typed_expr->type, frame.typed_stmts, typed_expr);
 
-        for (std::size_t i = 0; i < 2; ++i) {
-            typed_args[i] = args[i]->check(program, env, env.types().get_i64());
+                env.pop_scopes(frame.base);
+                typing.frames.pop_back();
+            }
+            break;
         }
 
-        switch (op) {
-        case ast::PrimApp::Op::ADD_W_I64: return program.add_w_i64(span, env.types().get_i64(), typed_args);
-        case ast::PrimApp::Op::SUB_W_I64: return program.sub_w_i64(span, env.types().get_i64(), typed_args);
-        case ast::PrimApp::Op::MUL_W_I64: return program.mul_w_i64(span, env.types().get_i64(), typed_args);
-        default: assert(false); // unreachable
+        case ExprTag::IF: {
+            If const& if_ = ifs[frame.expr.index()];
+
+            if (child == 0) {
+                typed_expr->type->unify(env.types().get_bool(), env.deferred(), span(if_.cond));
+                typing.exprs.push_back(typed_expr);
+                typed_expr = descend(program, typing, env, if_.conseq);
+            } else if (child == 1) {
+                typing.exprs.push_back(typed_expr);
+                typed_expr = descend(program, typing, env, if_.alt);
+            } else {
+                fast::Expr* const typed_cond = typing.exprs[frame.base];
+                fast::Expr* const typed_conseq = typing.exprs[frame.base + 1];
+                typing.exprs.resize(frame.base);
+
+                type::Type* const type = typed_conseq->type;
+                typed_expr->type->unify(type, env.deferred(), span(if_.alt)); // TODO: treat branch types equally
+                typed_expr = program.if_(if_.span, type, typed_cond, typed_conseq, typed_expr);
+                typing.frames.pop_back();
+            }
+            break;
         }
-    }
 
-    case ast::PrimApp::Op::EQ_I64: {
-        // FIXME: Brittle '2':s:
-        if (args.size() != 2) { throw type::PrimArgcError(span, 2, args.size()); }
+        case ExprTag::CALL: {
+            Call const& call = calls[frame.expr.index()];
+            std::span<Expr const> const args = exprs(call.args);
 
-        std::array<fast::Expr*, 2> typed_args;
+            if (child == 0) {
+                frame.callee_type = typed_expr->type->find()->as_callee(env.types(), args.size(), env.level(),
+                                                                        env.deferred(), span(call.callee));
+                typing.exprs.push_back(typed_expr);
+            } else {
+                typed_expr->type->unify(frame.callee_type->domain[child - 1], env.deferred(), span(args[child - 1]));
+                frame.typed_args[child - 1] = typed_expr;
+            }
 
-        for (std::size_t i = 0; i < 2; ++i) {
-            typed_args[i] = args[i]->check(program, env, env.types().get_i64());
+            if (child < args.size()) {
+                typed_expr = descend(program, typing, env, args[child]);
+            } else {
+                fast::Expr* const typed_callee = typing.exprs[frame.base];
+                typing.exprs.resize(frame.base);
+
+                typed_expr = program.call(call.span, frame.callee_type->codomain, typed_callee, frame.typed_args);
+                typing.frames.pop_back();
+            }
+            break;
         }
 
-        return program.eq_i64(span, env.types().get_bool(), typed_args);
-    }
+        case ExprTag::PRIM_APP: {
+            PrimApp const& prim_app = prim_apps[frame.expr.index()];
+            std::span<Expr const> const args = exprs(prim_app.args);
+            type::Types& types = env.types();
+
+            typed_expr->type->unify(types.get_i64(), env.deferred(), span(args[child]));
+            typing.exprs.push_back(typed_expr);
+
+            if (child + 1 < args.size()) {
+                typed_expr = descend(program, typing, env, args[child + 1]);
+            } else {
+                std::array<fast::Expr*, 2> const typed_args {typing.exprs[frame.base], typing.exprs[frame.base + 1]};
+                typing.exprs.resize(frame.base);
+
+                Span const span = prim_app.span;
+                switch (prim_app.op) {
+                case ast::PrimApp::Op::ADD_W_I64: typed_expr = program.add_w_i64(span, types.get_i64(), typed_args); break;
+                case ast::PrimApp::Op::SUB_W_I64: typed_expr = program.sub_w_i64(span, types.get_i64(), typed_args); break;
+                case ast::PrimApp::Op::MUL_W_I64: typed_expr = program.mul_w_i64(span, types.get_i64(), typed_args); break;
+                case ast::PrimApp::Op::EQ_I64: typed_expr = program.eq_i64(span, types.get_bool(), typed_args); break;
+                }
+                typing.frames.pop_back();
+            }
+            break;
+        }
 
-    default: assert(false); // unreachable
+        case ExprTag::ID: case ExprTag::BOOL: case ExprTag::INT: case ExprTag::COUNT: assert(false); // unreachable
+        }
     }
-}
 
-fast::Expr* ast::Bool::type_of(fast::Program& program, TypeEnv& env) const {
-    return program.const_bool(span, env.types().get_bool(), value);
+    return typed_expr;
 }
 
-fast::Expr* ast::Int::type_of(fast::Program& program, TypeEnv& env) const {
-    return program.const_i64(span, env.types().get_i64(), digits, strlen(digits));
-}
+// Push frames for enclosing nodes until reaching a subexpression that can be typed without any more of them:
+fast::Expr* ast::Program::descend(fast::Program& program, Typing& typing, TypeEnv& env, Expr expr) const {
+    while (true) {
+        switch (expr.tag()) {
+        case ExprTag::BLOCK: {
+            Block const& block = blocks[expr.index()];
+
+            if (block.stmts.count > 0) {
+                Typing::Frame& frame = typing.frames.emplace_back(Typing::Frame {
+                    expr, 0, env.depth(), program.stmts(block.stmts.count), nullptr, {}
+                });
+                expr = typing.block_child(*this, env, frame);
+            } else {
+                expr = block.body;
+            }
+            break;
+        }
+
+        case ExprTag::IF: {
+            typing.frames.push_back(Typing::Frame {expr, 0, typing.exprs.size(), {}, nullptr, {}});
+            expr = ifs[expr.index()].cond;
+            break;
+        }
+
+        case ExprTag::CALL: {
+            Call const& call = calls[expr.index()];
+            std::size_t const arity = call.args.count;
+
+            typing.frames.push_back(Typing::Frame {
+                expr, 0, typing.exprs.size(), {}, nullptr, program.args(arity)
+            });
+            expr = call.callee;
+            break;
+        }
+
+        case ExprTag::PRIM_APP: {
+            PrimApp const& prim_app = prim_apps[expr.index()];
+
+            // FIXME: Brittle '2':s:
+            if (prim_app.args.count != 2) { throw type::PrimArgcError(prim_app.span, 2, prim_app.args.count); }
+
+            typing.frames.push_back(Typing::Frame {expr, 0, typing.exprs.size(), {}, nullptr, {}});
+            expr = exprs(prim_app.args)[0];
+            break;
+        }
 
-fast::Expr* ast::Id::type_of(fast::Program& program, TypeEnv& env) const {
-    std::optional<std::pair<Name, type::Type*>> opt_binder = env.find(name);
-    if (opt_binder) {
-        return program.id(span, opt_binder->second, opt_binder->first);
-    } else {
-        throw type::UnboundError(span);
+        case ExprTag::ID: {
+            Id const& id = ids[expr.index()];
+
+            std::optional<std::pair<Name, type::Type*>> opt_binder = env.find(id.name);
+            if (opt_binder) {
+                typing.subst.clear();
+                type::Type* const type = opt_binder->second->instantiate(env.types(), env.level(), typing.subst);
+                return program.id(id.span, type, opt_binder->first, program.type_args(typing.subst.args));
+            } else {
+                throw type::UnboundError(id.span);
+            }
+        }
+
+        case ExprTag::BOOL: {
+            Bool const& b = bools[expr.index()];
+            return program.const_bool(b.span, env.types().get_bool(), b.value);
+        }
+
+        case ExprTag::INT: {
+            Int const& i = ints[expr.index()];
+            return program.const_i64(i.span, env.types().get_i64(), i.value);
+        }
+
+        case ExprTag::COUNT: assert(false); // unreachable
+        }
     }
 }
 
-fast::Expr* ast::Expr::check(fast::Program& program, TypeEnv& env, type::Type* type) const {
-    fast::Expr* expr = type_of(program, env);
-    expr->type->unify(type, span);
-    return expr;
+fast::Expr* ast::Program::check(fast::Program& program, Typing& typing, TypeEnv& env, Expr expr,
+                                 type::Type* type) const
+{
+    fast::Expr* typed_expr = type_of(program, typing, env, expr);
+    typed_expr->type->unify(type, env.deferred(), span(expr));
+    return typed_expr;
 }
 
 // # Patterns
 
-fast::Pat* ast::Pat::check(fast::Program& program, TypeEnv& env, type::Type* type) const {
-    auto const pat = type_of(program, env);
-    pat->type->unify(type, span);
-    return pat;
-}
-
-fast::Pat* ast::IdPat::type_of(fast::Program& program, TypeEnv& env) const {
-    auto const type = env.uv();
-    Name const unique_name = env.declare(name, type);
-    return program.id_pat(span, type, unique_name);
+fast::Pat* ast::Program::check(fast::Program& program, TypeEnv& env, Pat pat, type::Type* type) const {
+    auto const typed_pat = type_of(program, env, pat);
+    typed_pat->type->unify(type, env.deferred(), span(pat));
+    return typed_pat;
 }
 
-fast::Pat* ast::AnnPat::type_of(fast::Program& program, TypeEnv& env) const {
-    return pat->check(program, env, type);
-}
+fast::Pat* ast::Program::type_of(fast::Program& program, TypeEnv& env, Pat pat) const {
+    switch (pat.tag()) {
+    case PatTag::ID: {
+        IdPat const& id_pat = id_pats[pat.index()];
 
-// # Statements
+        auto const type = env.uv();
+        Name const unique_name = env.declare(id_pat.name, type);
+        return program.id_pat(id_pat.span, type, unique_name);
+    }
 
-std::pair<fast::Stmt*, TypeEnv> ast::Val::check(fast::Program& program, TypeEnv& parent_env) const {
-    TypeEnv env = parent_env.push_frame();
+    case PatTag::ANN: {
+        AnnPat const& ann_pat = ann_pats[pat.index()];
 
-    fast::Expr* const typed_val_expr = val_expr->type_of(program, env);
-    auto const typed_pat = pat->check(program, env, typed_val_expr->type);
+        return check(program, env, ann_pat.pat, ann_pat.type);
+    }
 
-    auto const stmt = program.val(span, typed_pat, typed_val_expr);
-    return {stmt, std::move(env)};
+    case PatTag::COUNT: break;
+    }
+    assert(false); // unreachable
 }
 
 // # Unification
 
-void type::Type::unify(Type* other, Span span) {
+void type::Type::unify(Type* other, Deferred& deferred, Span span) {
     Type* found_this = find();
     Type* found_other = other->find();
 
     if (found_this != found_other) {
-        found_this->unifyFounds(found_other, span);
+        found_this->unifyFounds(found_other, deferred, span);
     }
 }
 
-void type::Uv::unifyFoundUvs(type::Uv* uv, Span) {
+void type::Uv::unifyFoundUvs(type::Uv* uv, Deferred&, Span) {
     uv->union_(this);
 }
 
-void type::Type::unifyFoundUvs(type::Uv* uv, Span span) {
-    occurs_check(uv, span);
+void type::Type::unifyFoundUvs(type::Uv* uv, Deferred&, Span) {
+    uv->set(this); // Ground, so it has no `Uv`:s to lower or to contain `uv`
+}
+
+// Constant time, see `FnType`:
+void type::FnType::unifyFoundUvs(type::Uv* uv, Deferred& deferred, Span span) {
+    if (!interned_) {
+        lower_level(uv->level(), deferred);
+        deferred.bindings.push_back(Deferred::Binding {this, span});
+    }
     uv->set(this);
 }
 
-void type::Uv::unifyFoundFns(FnType* other, Span span) { other->unifyFoundUvs(this, span); }
+void type::Uv::unifyFoundFns(FnType* other, Deferred& deferred, Span span) {
+    other->unifyFoundUvs(this, deferred, span);
+}
+
+void type::Uv::unifyFoundBools(Bool* other, Deferred& deferred, Span span) {
+    other->unifyFoundUvs(this, deferred, span);
+}
+
+void type::Uv::unifyFoundI64s(I64* other, Deferred& deferred, Span span) {
+    other->unifyFoundUvs(this, deferred, span);
+}
 
-void type::Uv::unifyFoundBools(Bool* other, Span span) { other->unifyFoundUvs(this, span); }
+void type::FnType::unifyFoundFns(type::FnType* other, Deferred& deferred, Span span) {
+    if (domain.size() != other->domain.size()) { throw type::UnificationError(span, other, this); }
 
-void type::Uv::unifyFoundI64s(I64* other, Span span) { other->unifyFoundUvs(this, span); }
+    // Getting back to a function type that is being unified means that it contains itself. Assume that they unify, so
+    // that the occurs check at the next generalization reports the cycle at a binding that reaches it instead of
+    // wherever unification happened to run into it:
+    if (visiting_ || other->visiting_) { return; }
 
-void type::FnType::unifyFoundFns(type::FnType* other, Span span) {
-    auto dom = domain.begin();
-    auto other_dom = other->domain.begin();
-    for (;; ++dom, ++other_dom) {
-        if (dom != domain.end()) {
-            if (other_dom != other->domain.end()) {
-                (*other_dom)->unify(*dom, span);
-            } else {
-                throw type::UnificationError(span, other, this);
-            }
-        } else {
-            if (other_dom == other->domain.end()) {
-                break;
-            } else {
-                throw type::UnificationError(span, other, this);
-            }
-        }
+    // Both become the same type, so their parts will have to be at the lower level:
+    std::uint32_t const level = std::min(this->level(), other->level());
+    lower_level(level, deferred);
+    other->lower_level(level, deferred);
+
+    // Unmarks on the way out, also when unifying the parts fails, since the occurs check can still run after that.
+    // Interned ones are ground, so never part of a cycle (and other threads share them, so they must not be written):
+    struct Visit {
+        FnType* fn;
+
+        explicit Visit(FnType* fn_) : fn(fn_) { if (!fn->interned_) { fn->visiting_ = true; } }
+        ~Visit() { if (!fn->interned_) { fn->visiting_ = false; } }
+    };
+    Visit const this_visit(this);
+    Visit const other_visit(other);
+
+    for (std::size_t i = 0; i < domain.size(); ++i) {
+        other->domain[i]->unify(domain[i], deferred, span);
     }
+    codomain->unify(other->codomain, deferred, span);
+}
 
-    codomain->unify(other->codomain, span);
+void type::Type::unifyFoundFns(type::FnType* other, Deferred&, Span span) {
+    throw type::UnificationError(span, other, this);
 }
 
-void type::Type::unifyFoundFns(type::FnType* other, Span span) { throw type::UnificationError(span, other, this); }
+void type::Bool::unifyFoundBools(Bool*, Deferred&, Span) {}
 
-void type::Bool::unifyFoundBools(Bool*, Span) {}
+void type::Type::unifyFoundBools(Bool* other, Deferred&, Span span) { throw type::UnificationError(span, other, this); }
 
-void type::Type::unifyFoundBools(Bool* other, Span span) { throw type::UnificationError(span, other, this); }
+void type::I64::unifyFoundI64s(I64*, Deferred&, Span) {}
 
-void type::I64::unifyFoundI64s(I64*, Span) {}
+void type::Type::unifyFoundI64s(I64* other, Deferred&, Span span) { throw type::UnificationError(span, other, this); }
 
-void type::Type::unifyFoundI64s(I64* other, Span span) { throw type::UnificationError(span, other, this); }
+// ## Calls
 
-// ## Occurs Check
+type::FnType* type::Type::as_callee(Types& types, std::size_t arity, std::uint32_t level, Deferred& deferred,
+                                    Span span)
+{
+    FnType* const callee_type = types.fresh_fn(arity, level);
+    unify(callee_type, deferred, span);
+    return callee_type;
+}
 
-void type::Type::occurs_check(Uv *uv, Span span) const {
-    if (this == uv) {
-        throw type::OccursError(span, uv, this);
-    } else {
-        occurs_check_children(uv, span);
-    }
+type::FnType* type::FnType::as_callee(Types& types, std::size_t arity, std::uint32_t level, Deferred& deferred,
+                                      Span span)
+{
+    if (domain.size() == arity) { return this; }
+
+    return Type::as_callee(types, arity, level, deferred, span); // To report the mismatch
 }
 
-void type::Uv::occurs_check_children(Uv* uv, Span span) const {
-    parent_.iter([&] (Type const* parent) {
-        parent->occurs_check(uv, span);
-    });
+// ## Levels
+
+void type::Type::lower_level(std::uint32_t, Deferred&) {}
+
+void type::Uv::lower_level(std::uint32_t level, Deferred&) {
+    assert(parent_.is_none());
+
+    level_ = std::min(level_, level);
+}
+
+void type::FnType::lower_level(std::uint32_t level, Deferred& deferred) {
+    if (interned_ || level >= level_) { return; }
+
+    if (level_ == adjusted_level_) { deferred.unadjusted.push_back(this); }
+    level_ = level;
 }
 
-void type::FnType::occurs_check_children(Uv* uv, Span span) const {
-    for (Type const* dom : domain) {
-        dom->occurs_check(uv, span);
+void type::FnType::adjust_level(Deferred& deferred) {
+    for (Type* const dom : domain) {
+        dom->find()->lower_level(level_, deferred);
     }
+    codomain->find()->lower_level(level_, deferred);
 
-    codomain->occurs_check(uv, span);
+    adjusted_level_ = level_;
 }
 
-void type::Type::occurs_check_children(Uv*, Span) const {}
+// ## Occurs Check
+
+void type::Type::occurs_check(std::uint32_t, Span) {}
+
+void type::FnType::occurs_check(std::uint32_t sweep, Span span) {
+    if (interned_ || sweep_ == sweep) { return; }
+    if (visiting_) { throw type::OccursError(span, this); }
+
+    visiting_ = true;
+    for (Type* const dom : domain) {
+        dom->find()->occurs_check(sweep, span);
+    }
+    codomain->find()->occurs_check(sweep, span);
+    visiting_ = false;
+
+    sweep_ = sweep;
+}
 
 } // namespace brmh
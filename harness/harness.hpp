@@ -0,0 +1,85 @@
+#ifndef BRMH_HARNESS_HPP
+#define BRMH_HARNESS_HPP
+
+// What the benchmarks in bench/ and the tests in test/ share: generated source files and a front end fixture. Each of
+// them is its own unity build of the whole compiler with the driver `main` renamed out of the way, so that it can
+// drive the phases directly, and generates its inputs instead of reading them from the tree.
+
+#define main brmh_main
+#include "../cpp/main.cpp"
+#undef main
+
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace brmh::harness {
+
+// A generated source file that is deleted again at scope exit:
+class TempFile {
+public:
+    explicit TempFile(std::string const& contents) {
+        char const* const dir = std::getenv("TMPDIR");
+        path_ = std::string(dir ? dir : "/tmp") + "/brmh-XXXXXX";
+        int const fd = mkstemp(path_.data());
+        if (fd < 0) {
+            std::perror("mkstemp");
+            std::exit(EXIT_FAILURE);
+        }
+        close(fd);
+        std::ofstream(path_, std::ios::binary) << contents;
+    }
+
+    TempFile(TempFile const&) = delete;
+    TempFile& operator=(TempFile const&) = delete;
+    ~TempFile() { std::remove(path_.c_str()); }
+
+    char const* path() const { return path_.c_str(); }
+
+private:
+    std::string path_;
+};
+
+// The front end of the driver on generated files, lexed, parsed and merged in order on construction:
+struct Frontend {
+    explicit Frontend(std::string const& source) : Frontend(std::vector<std::string> {source}) {}
+
+    explicit Frontend(std::vector<std::string> const& file_sources)
+        : files(), sources(), file_ids(), names(), types(names), tokens(), program()
+    {
+        std::vector<ast::Program> programs;
+        tokens.reserve(file_sources.size());
+        for (std::string const& source : file_sources) {
+            files.emplace_back(source);
+            file_ids.push_back(sources.add(Src::file(files.back().path())));
+            tokens.push_back(Lexer::tokenize(sources, file_ids.back(), names));
+            programs.push_back(Parser(tokens.back(), names, types).program());
+        }
+        program = ast::Program::merge(std::move(programs));
+    }
+
+    fast::Program check(std::size_t jobs) { return program.check(names, types, jobs); }
+
+    // "line:column" of `pos`, as in diagnostics:
+    std::string line_col(Pos pos) const {
+        SourceMap::LineCol const line_col = sources.line_col(pos);
+        return std::to_string(line_col.line) + ':' + std::to_string(line_col.column);
+    }
+
+    std::deque<TempFile> files; // `TempFile`s do not move
+    SourceMap sources;
+    std::vector<FileId> file_ids;
+    Names names;
+    type::Types types;
+    std::vector<TokenBuffer> tokens;
+    ast::Program program;
+};
+
+} // namespace brmh::harness
+
+#endif // BRMH_HARNESS_HPP
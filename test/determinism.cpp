@@ -0,0 +1,56 @@
+// The dumps must not depend on the number of jobs: checking in parallel numbers fresh names per component in component
+// order, and the CPS printer orders blocks and exprs by graph traversal rather than by address.
+
+#include "test.hpp"
+
+#include <sstream>
+
+using namespace brmh;
+
+static constexpr std::size_t FN_COUNT = 200;
+
+// A call DAG of small functions with some mutually recursive pairs, so that there are many components of different
+// sizes and each instantiates the polymorphic `ign` and `konst`:
+static std::string call_dag() {
+    std::string source = "fun ign(y) : i64 { 1 }\nfun konst(x, y) : i64 { x }\nfun g0(n) : i64 { ign(n) }\n";
+    for (std::size_t i = 1; i < FN_COUNT; ++i) {
+        std::string const g = 'g' + std::to_string(i);
+        std::string const prev = 'g' + std::to_string(i - 1);
+        std::string const half = 'g' + std::to_string(i / 2);
+        if (i % 7 == 3) {
+            std::string const h = 'h' + std::to_string(i);
+            source += "fun " + g + "(n) : i64 { if __eqI64(n, 0) { 0 } else { " + h + "(__subWI64(n, 1)) } }\n";
+            source += "fun " + h + "(n) : i64 { val b = ign(True); " + g + "(n) }\n";
+        } else {
+            source += "fun " + g + "(n) : i64 { val a = " + prev + "(n); val b = konst(a, True); __addWI64(b, " + half
+                + "(0)) }\n";
+        }
+    }
+    return source;
+}
+
+// The F-AST and CPS dumps of `source`, checked on up to `jobs` threads:
+static std::string dumps(std::string const& source, std::size_t jobs) {
+    harness::Frontend frontend(source);
+    fast::Program const typed_program = frontend.check(jobs);
+
+    std::ostringstream out;
+    typed_program.print(frontend.names, out);
+    cps::Program const cps_program = typed_program.to_cps(frontend.names, frontend.types);
+    BumpArena scratch;
+    cps_program.print(frontend.names, out, scratch);
+    return out.str();
+}
+
+int main() {
+    std::string const source = call_dag();
+    std::string const expected = dumps(source, 1);
+
+    EXPECT(!expected.empty());
+    for (std::size_t const jobs : {2, 4, 16}) {
+        EXPECT(dumps(source, jobs) == expected);
+    }
+    EXPECT(dumps(source, 16) == dumps(source, 16));
+
+    return test::exit_status();
+}
@@ -0,0 +1,64 @@
+// Printed fresh names must not depend on which threads created them when the work is split into `Names::Unit`s, and
+// must survive compaction. Compaction must count only the ids that were handed out as reclaimable.
+
+#include "test.hpp"
+
+#include <sstream>
+
+using namespace brmh;
+
+static constexpr std::size_t TASK_COUNT = 32;
+static constexpr std::size_t NAMES_PER_TASK = 1000; // So that tasks span fresh id blocks
+
+// Every task makes fresh names in its own unit, on up to `jobs` threads. Returns them all printed, in task order:
+static std::string print_fresh_names(std::size_t jobs) {
+    Names names;
+    Name const x = names.sourced("x", 1);
+    Name const before = names.fresh(); // Outside of any unit
+
+    std::vector<Names::Unit> units(TASK_COUNT, Names::Unit(names));
+    std::vector<std::vector<Name>> task_names(TASK_COUNT);
+    parallel_for(TASK_COUNT, jobs, [&](std::size_t task) {
+        Names::UnitScope const scope(units[task]);
+        for (std::size_t i = 0; i < NAMES_PER_TASK; ++i) {
+            task_names[task].push_back(i % 2 == 0 ? names.freshen(x) : names.fresh());
+        }
+    });
+    for (Names::Unit& unit : units) { names.number(unit); }
+
+    std::ostringstream out;
+    x.print(names, out);
+    before.print(names, out);
+    for (std::vector<Name> const& task : task_names) {
+        for (Name const name : task) { name.print(names, out); }
+    }
+
+    // Compaction renumbers ids but not printed names:
+    Names::Compaction compaction(names);
+    for (std::vector<Name>& task : task_names) {
+        for (Name& name : task) { compaction.keep(name); }
+    }
+    Names::Compaction::Stats const stats = compaction.finish();
+    EXPECT(stats.issued == 2 + TASK_COUNT * NAMES_PER_TASK); // With `x` and `before`
+    EXPECT(stats.live == TASK_COUNT * NAMES_PER_TASK);
+    std::ostringstream compacted;
+    for (std::vector<Name> const& task : task_names) {
+        for (Name const name : task) { name.print(names, compacted); }
+    }
+    EXPECT(out.str().ends_with(compacted.str()));
+
+    return out.str();
+}
+
+int main() {
+    std::string expected = "x$1";
+    for (std::size_t i = 0; i < TASK_COUNT * NAMES_PER_TASK; ++i) {
+        expected += (i % 2 == 0 ? "x$" : "$") + std::to_string(i + 2);
+    }
+
+    EXPECT(print_fresh_names(1) == expected);
+    EXPECT(print_fresh_names(4) == expected);
+    EXPECT(print_fresh_names(TASK_COUNT) == expected);
+
+    return test::exit_status();
+}
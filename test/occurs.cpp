@@ -0,0 +1,50 @@
+// The occurs check is deferred to generalization, but must still report a cycle at the binding that made it rather
+// than wherever checking first ran into it: unification of cyclic types or a later type error.
+
+#include "test.hpp"
+
+using namespace brmh;
+
+// "line:column" of the `OccursError` that checking `source` on `jobs` threads throws, or "none":
+static std::string occurs_at(std::string const& source, std::size_t jobs) {
+    harness::Frontend frontend(source + "\nfun main() : i64 { 0 }\n");
+    try {
+        frontend.check(jobs);
+    } catch (type::OccursError const& error) {
+        return frontend.line_col(error.span.start_pos());
+    } catch (type::Error const& error) {
+        return std::string(error.what()) + " at " + frontend.line_col(error.span.start_pos());
+    }
+    return "none";
+}
+
+static void expect_occurs_at(std::string const& source, std::string const& expected) {
+    for (std::size_t const jobs : {1, 4}) {
+        std::string const actual = occurs_at(source, jobs);
+        if (!EXPECT(actual == expected)) {
+            std::cerr << "    " << source << "\n    at " << jobs << " jobs: " << actual << ", not " << expected
+                      << std::endl;
+        }
+    }
+}
+
+int main() {
+    // At the callee, whose binding closes the cycle:
+    expect_occurs_at("fun f(x) : i64 { x(x) }", "1:18");
+
+    // At `z(z)`, not at `x(z)`, although the binding of `x` reaches the cycle too:
+    expect_occurs_at("fun f(x, z) : i64 { val a = z(z); x(z) }", "1:29");
+    expect_occurs_at("fun g(y, z) : i64 { 0 }\nfun f(x) : i64 { val a = x(x); g(x, a) }", "2:26");
+
+    // At `x(x)`, not at the `if` that unifies the two cyclic types:
+    expect_occurs_at("fun f(x, y) : i64 { val a = x(x); val b = y(y); val c = if True { x } else { y }; 0 }", "1:29");
+    expect_occurs_at("fun f(x, y) : i64 { val c = if True { x } else { y }; val a = x(x); val b = y(y); 0 }", "1:63");
+
+    // At `x(x)`, not at the mismatch that follows it:
+    expect_occurs_at("fun f(x) : i64 { val a = x(x); x(1) }", "1:26");
+
+    // Higher-order but acyclic:
+    expect_occurs_at("fun twice(f, x) : i64 { f(f(x)) }", "none");
+
+    return test::exit_status();
+}
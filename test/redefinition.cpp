@@ -0,0 +1,29 @@
+// Defs of the same name, in one file or in two, must be reported at the second one rather than checked as one def
+// (which later crashed `to_cps`).
+
+#include "test.hpp"
+
+using namespace brmh;
+
+// File index and "line:column" of the `RedefinitionError` that checking `sources` throws, or "none":
+static std::string redefinition_at(std::vector<std::string> const& sources) {
+    harness::Frontend frontend(sources);
+    try {
+        frontend.check(4);
+    } catch (type::RedefinitionError const& error) {
+        std::size_t file = 0;
+        while (frontend.file_ids[file] != error.span.file) { ++file; }
+        return std::to_string(file) + ' ' + frontend.line_col(error.span.start_pos());
+    }
+    return "none";
+}
+
+int main() {
+    std::string const foo = "fun foo(n) : i64 { n }\n";
+
+    EXPECT(redefinition_at({foo + "\nfun main() : i64 { foo(1) }\n", "fun bar() : i64 { 0 }\n\n" + foo}) == "1 3:1");
+    EXPECT(redefinition_at({foo + "fun bar() : i64 { 0 }\n" + foo + "fun main() : i64 { 0 }\n"}) == "0 3:1");
+    EXPECT(redefinition_at({foo, "fun main() : i64 { foo(1) }\n"}) == "none");
+
+    return test::exit_status();
+}
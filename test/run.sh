@@ -0,0 +1,19 @@
+#! /bin/sh
+
+# Build and run every test in test/. Run from the repository root, like build.sh.
+# `CXX` and `CXXFLAGS` are passed through, e.g. to point at a different LLVM.
+
+mkdir -p test/bin
+status=0
+for test in test/*.cpp; do
+    bin="test/bin/`basename "$test" .cpp`"
+    ${CXX:-c++} ${CXXFLAGS} `llvm-config --cxxflags` -std=c++20 -O2 -pthread -fexceptions -Wall -Wextra -Werror \
+        "$test" -o "$bin" `llvm-config --ldflags --system-libs --libs core` || exit 1
+    if "$bin"; then
+        echo "PASS $bin"
+    else
+        echo "FAIL $bin"
+        status=1
+    fi
+done
+exit $status
@@ -0,0 +1,59 @@
+// Deep nesting and long blocks must get through lexing, parsing and checking, which use explicit stacks instead of
+// recursion. Printing and `to_cps` still recurse, so compiling these all the way still overflows the stack.
+
+#include "test.hpp"
+
+using namespace brmh;
+
+// `fun main () : i64 { __addWI64(1, __addWI64(1, ... 0)) }`, `depth` calls deep:
+static std::string deep_prim_apps(std::size_t depth) {
+    std::string source = "fun main () : i64 { ";
+    for (std::size_t i = 0; i < depth; ++i) { source += "__addWI64(1, "; }
+    source += '0';
+    source.append(depth, ')');
+    return source + " }\n";
+}
+
+// Blocks, ifs and calls of an identity function, nested `depth` deep:
+static std::string deep_mix(std::size_t depth) {
+    std::string source = "fun id(x) : i64 { x }\n\nfun main () : i64 { ";
+    for (std::size_t i = 0; i < depth; ++i) {
+        switch (i % 3) {
+        case 0: source += "{ "; break;
+        case 1: source += "if True { "; break;
+        case 2: source += "id("; break;
+        }
+    }
+    source += '1';
+    for (std::size_t i = depth; i-- > 0;) {
+        switch (i % 3) {
+        case 0: source += " }"; break;
+        case 1: source += " } else { 0 }"; break;
+        case 2: source += ')'; break;
+        }
+    }
+    return source + " }\n";
+}
+
+// A block of `count` vals, each referring to the previous one:
+static std::string long_block(std::size_t count) {
+    std::string source = "fun main () : i64 {\n    val x0 = 1;\n";
+    for (std::size_t i = 1; i < count; ++i) {
+        source += "    val x" + std::to_string(i) + " = __addWI64(x" + std::to_string(i - 1) + ", 1);\n";
+    }
+    return source + "    x" + std::to_string(count - 1) + "\n}\n";
+}
+
+static void check(std::string const& source, std::size_t def_count) {
+    harness::Frontend frontend(source);
+    fast::Program const program = frontend.check(1);
+    EXPECT(program.defs.size() == def_count);
+}
+
+int main() {
+    check(deep_prim_apps(100000), 1);
+    check(deep_mix(100000), 2);
+    check(long_block(1000000), 1);
+
+    return test::exit_status();
+}
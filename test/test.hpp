@@ -0,0 +1,31 @@
+#ifndef BRMH_TEST_HPP
+#define BRMH_TEST_HPP
+
+// Shared scaffolding for the tests in this directory, which run.sh builds and runs.
+
+#include "../harness/harness.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace brmh::test {
+
+inline int failures = 0;
+
+// Reports a failed expectation. Tests keep going so that they report every failure; see `exit_status`.
+#define EXPECT(cond) ::brmh::test::expect((cond), #cond, __FILE__, __LINE__)
+
+inline bool expect(bool ok, char const* cond, char const* file, int line) {
+    if (!ok) {
+        std::cerr << file << ':' << line << ": expected " << cond << std::endl;
+        ++failures;
+    }
+    return ok;
+}
+
+inline int exit_status() { return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE; }
+
+} // namespace brmh::test
+
+#endif // BRMH_TEST_HPP